@@ -0,0 +1,17 @@
+TEMPLATE = app
+
+TARGET = citydb
+
+# Host tool building the city database, not installed
+CONFIG += console
+CONFIG -= qt app_bundle
+
+VPATH += ../prayertimes/
+INCLUDEPATH += ../prayertimes/
+DEPENDPATH += ../prayertimes/
+
+SOURCES += citydb.cpp
+
+HEADERS += citydb.hpp
+
+QMAKE_CXXFLAGS += -std=c++0x
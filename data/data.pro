@@ -0,0 +1,23 @@
+TEMPLATE = aux
+
+# GeoNames dump the city database is built from, such as cities15000.txt
+# from https://download.geonames.org/export/dump/, set with
+# qmake GEONAMES=<path>
+isEmpty(GEONAMES): GEONAMES = $$PWD/cities15000.txt
+
+exists($$GEONAMES) {
+    cities.target = cities.db
+    cities.commands = $$OUT_PWD/../citydb/citydb --build $$GEONAMES --output $$cities.target
+    cities.depends = $$GEONAMES $$OUT_PWD/../citydb/citydb
+    first.depends = $$cities.target
+    QMAKE_EXTRA_TARGETS += first cities
+    QMAKE_CLEAN += $$cities.target
+
+    # Looked up by CitySearchModel next to the executable
+    citydb.files = $$OUT_PWD/$$cities.target
+    citydb.path = /usr/share/harbour-prayer
+    citydb.CONFIG += no_check_exist
+    INSTALLS += citydb
+} else {
+    warning("$$GEONAMES not found, the city database will not be built")
+}
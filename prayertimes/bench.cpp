@@ -0,0 +1,321 @@
+/*-------------------- In the name of God ----------------------*\
+
+    PrayerTimes benchmark
+    Measures the cost of the prayer times calculation engine
+    Build with optimizations for meaningful numbers, for instance
+    with -DCMAKE_BUILD_TYPE=Release
+
+    Part of PrayerTimes, see prayertimes.cpp for copyright and license.
+
+\*--------------------------------------------------------------*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <getopt.h>
+
+#include "prayertimes.hpp"
+#include "schedule.hpp"
+
+using prayertimes::PrayerTimes;
+using prayertimes::Location;
+using prayertimes::TimesCount;
+
+static const char* const CalculationMethodName[] =
+{
+	"MWL",
+	"ISNA",
+	"Egypt",
+	"Makkah",
+	"Karachi",
+	"Jafari",
+	"Tehran",
+	"Custom",
+};
+
+// Representative latitudes, from the equator to where the sun doesn't set
+static const Location bench_locations[] =
+{
+	{  0.0,     30.0,     0.0,   2.0 },
+	{ 21.4225,  39.8262,  277.0, 3.0 },
+	{ 35.6892,  51.3890,  1200.0, 3.5 },
+	{ 51.5074,  -0.1278,  11.0,  0.0 },
+	{ 60.1699,  24.9384,  17.0,  2.0 },
+	{ 69.6492,  18.9553,  10.0,  1.0 },
+	{ 78.2232,  15.6267,  8.0,   1.0 },
+};
+
+static const int BENCH_LOCATIONS_COUNT = sizeof(bench_locations) / sizeof(bench_locations[0]);
+static const int BENCH_BATCH_SIZE = 1024;		// Locations per batch call
+
+// Exposes the protected parts of PrayerTimes measured below
+class BenchPrayerTimes : public PrayerTimes
+{
+public:
+	using PrayerTimes::Context;
+	using PrayerTimes::make_context;
+	using PrayerTimes::compute_times;
+	using PrayerTimes::sun_position;
+
+	explicit BenchPrayerTimes(prayertimes::CalculationMethod calc_method) : PrayerTimes(calc_method)
+	{
+	}
+};
+
+// Options shared by all benchmarks
+struct BenchOptions
+{
+	int samples;		// Number of timed samples
+	int batch;		// Calls per sample
+	const char* filter;		// Only run benchmarks whose name contains it
+};
+
+// Results are written as they come, as JSON objects of a list
+static bool first_result = true;
+
+// Keeps results from being optimized out
+static volatile double sink;
+
+// Time a function called with an increasing counter, writing the
+// distribution of its cost per operation. ops is the number of operations
+// done by each call.
+template <class Function>
+static void bench(const BenchOptions& options, const char* name, const char* method, double latitude,
+		int ops, Function function)
+{
+	if (options.filter && !strstr(name, options.filter))
+		return;
+
+	std::vector<double> ns(options.samples);
+	double total = 0.0;
+	long counter = 0;
+	for (int s = 0; s < options.samples; ++s)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < options.batch; ++i)
+			function(counter++);
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		ns[s] = elapsed.count() / ((double) options.batch * ops);
+		total += ns[s];
+	}
+	std::sort(ns.begin(), ns.end());
+	double mean = total / options.samples;
+
+	printf("%s\n    { \"name\": \"%s\"", first_result ? "" : ",", name);
+	first_result = false;
+	if (method)
+		printf(", \"method\": \"%s\"", method);
+	if (latitude == latitude)
+		printf(", \"latitude\": %g", latitude);
+	printf(", \"ns_per_op\": { \"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"mean\": %.1f }, "
+			"\"calls_per_sec\": %.0f }",
+			ns[0], ns[ns.size() / 2], ns[ns.size() * 9 / 10], ns[ns.size() * 99 / 100], mean, 1e9 / mean);
+	fflush(stdout);
+}
+
+// Day of a year counted from January 1st, for julian()
+static int bench_day(long counter)
+{
+	return 1 + counter % 365;
+}
+
+static void print_help(FILE* f, const char* program)
+{
+	fprintf(f, "Usage: %s [options]\n"
+			"  Time the prayer times engine and write the results as JSON\n"
+			"\n"
+			"    --samples arg   -n  number of timed samples per benchmark (default 200)\n"
+			"    --batch arg     -b  number of calls per sample (default 50)\n"
+			"    --filter arg    -f  only run benchmarks whose name contains arg\n"
+			"    --help          -h  display this message\n",
+			program);
+}
+
+int main(int argc, char* argv[])
+{
+	BenchOptions options = { 200, 50, NULL };
+
+	static struct option long_options[] =
+	{
+		{ "samples", required_argument, NULL, 'n' },
+		{ "batch",   required_argument, NULL, 'b' },
+		{ "filter",  required_argument, NULL, 'f' },
+		{ "help",    no_argument,       NULL, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	for (;;)
+	{
+		int c = getopt_long(argc, argv, "n:b:f:h", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+			case 'n':
+				options.samples = atoi(optarg);
+				break;
+			case 'b':
+				options.batch = atoi(optarg);
+				break;
+			case 'f':
+				options.filter = optarg;
+				break;
+			case 'h':
+				print_help(stdout, argv[0]);
+				return 0;
+			default:
+				print_help(stderr, argv[0]);
+				return 2;
+		}
+	}
+	if (options.samples <= 0 || options.batch <= 0)
+	{
+		fprintf(stderr, "Error: Invalid number of samples or calls\n");
+		return 2;
+	}
+
+	double jd = PrayerTimes::julian(2024, 1, 1);
+	prayertimes::SolarEphemeris ephemeris(jd, 366);
+	time_t now = time(NULL);
+
+	printf("{\n  \"samples\": %d,\n  \"batch\": %d,\n  \"benchmarks\": [", options.samples, options.batch);
+
+	//------------------------ Date and Sun -------------------------
+
+	bench(options, "julian", NULL, NAN, 1, [](long i) {
+		sink = PrayerTimes::julian(2024, 1 + i % 12, 1 + i % 28);
+	});
+
+	bench(options, "sun_position", NULL, NAN, 1, [=](long i) {
+		sink = prayertimes::SolarEphemeris::compute_sun_position(jd + (i % 36500) * 0.01).second;
+	});
+
+	bench(options, "sun_position/precise", NULL, NAN, 1, [=](long i) {
+		sink = prayertimes::SolarEphemeris::compute_precise_sun_position(jd + (i % 36500) * 0.01).second;
+	});
+
+	bench(options, "sun_position/ephemeris", NULL, NAN, 1, [&](long i) {
+		sink = BenchPrayerTimes::sun_position(&ephemeris, jd + (i % 36500) * 0.01).second;
+	});
+
+	//------------------------ Prayer Times -------------------------
+
+	for (int m = 0; m < prayertimes::CalculationMethodsCount; ++m)
+	{
+		BenchPrayerTimes prayer_times(static_cast<prayertimes::CalculationMethod>(m));
+		for (int l = 0; l < BENCH_LOCATIONS_COUNT; ++l)
+		{
+			const Location& location = bench_locations[l];
+
+			bench(options, "compute_times", CalculationMethodName[m], location.latitude, 1, [&](long i) {
+				BenchPrayerTimes::Context context = prayer_times.make_context(location, jd + bench_day(i) - 1, false);
+				double times[TimesCount];
+				prayer_times.compute_times(context, times);
+				sink = times[prayertimes::Dhuhr];
+			});
+
+			bench(options, "get_prayer_times/date", CalculationMethodName[m], location.latitude, 1, [&](long i) {
+				double times[TimesCount];
+				prayer_times.get_prayer_times(2024, 1, bench_day(i), location, times);
+				sink = times[prayertimes::Dhuhr];
+			});
+		}
+	}
+
+	PrayerTimes prayer_times;
+	PrayerTimes shared_prayer_times;
+	shared_prayer_times.set_ephemeris(&ephemeris);
+	PrayerTimes high_prayer_times, hybrid_prayer_times;
+	high_prayer_times.set_precision(prayertimes::HighPrecision);
+	hybrid_prayer_times.set_precision(prayertimes::HybridPrecision);
+	for (int l = 0; l < BENCH_LOCATIONS_COUNT; ++l)
+	{
+		const Location& location = bench_locations[l];
+
+		bench(options, "get_prayer_times/time_t", "MWL", location.latitude, 1, [&](long i) {
+			double times[TimesCount];
+			prayer_times.get_prayer_times(now + (i % 365) * 86400, location.latitude, location.longitude,
+					location.elevation, location.timezone, times);
+			sink = times[prayertimes::Dhuhr];
+		});
+
+		bench(options, "get_prayer_times/ephemeris", "MWL", location.latitude, 1, [&](long i) {
+			double times[TimesCount];
+			shared_prayer_times.get_prayer_times(2024, 1, bench_day(i), location, times);
+			sink = times[prayertimes::Dhuhr];
+		});
+
+		bench(options, "get_prayer_times/high_precision", "MWL", location.latitude, 1, [&](long i) {
+			double times[TimesCount];
+			high_prayer_times.get_prayer_times(2024, 1, bench_day(i), location, times);
+			sink = times[prayertimes::Dhuhr];
+		});
+
+		bench(options, "get_prayer_times/hybrid_precision", "MWL", location.latitude, 1, [&](long i) {
+			double times[TimesCount];
+			hybrid_prayer_times.get_prayer_times(2024, 1, bench_day(i), location, times);
+			sink = times[prayertimes::Dhuhr];
+		});
+
+		std::vector<double> range_times(365 * TimesCount);
+		bench(options, "get_prayer_times_range", "MWL", location.latitude, 365, [&](long) {
+			prayer_times.get_prayer_times_range(2024, 1, 1, 365, location.latitude, location.longitude,
+					location.elevation, location.timezone, &range_times[0]);
+			sink = range_times[prayertimes::Dhuhr];
+		});
+	}
+
+	// Locations spread over all latitudes, per location
+	std::vector<double> latitudes(BENCH_BATCH_SIZE), longitudes(BENCH_BATCH_SIZE);
+	std::vector<double> elevations(BENCH_BATCH_SIZE, 0.0), timezones(BENCH_BATCH_SIZE, 0.0);
+	std::vector<double> batch_times(BENCH_BATCH_SIZE * TimesCount);
+	for (int k = 0; k < BENCH_BATCH_SIZE; ++k)
+	{
+		latitudes[k] = -80.0 + 160.0 * k / BENCH_BATCH_SIZE;
+		longitudes[k] = -180.0 + 360.0 * ((k * 37) % BENCH_BATCH_SIZE) / BENCH_BATCH_SIZE;
+	}
+	for (int fast_trig = 0; fast_trig <= 1; ++fast_trig)
+	{
+		PrayerTimes batch_prayer_times;
+		batch_prayer_times.set_fast_trig(fast_trig);
+		bench(options, fast_trig ? "get_prayer_times/batch_fast_trig" : "get_prayer_times/batch", "MWL", NAN,
+				BENCH_BATCH_SIZE, [&](long i) {
+			batch_prayer_times.get_prayer_times(2024, 1, bench_day(i), BENCH_BATCH_SIZE, &latitudes[0],
+					&longitudes[0], &elevations[0], &timezones[0], &batch_times[0]);
+			sink = batch_times[prayertimes::Dhuhr];
+		});
+	}
+
+	//------------------------ Schedule -------------------------
+
+	for (int l = 0; l < BENCH_LOCATIONS_COUNT; ++l)
+	{
+		const Location& location = bench_locations[l];
+		prayertimes::Schedule schedule(prayer_times, location);
+
+		// Queries a minute apart, as a countdown refreshing its display
+		bench(options, "schedule/get_events", "MWL", location.latitude, 1, [&](long i) {
+			prayertimes::Event current, next;
+			schedule.get_events(now + i * 60, current, next);
+			sink = next.instant;
+		});
+	}
+
+	//------------------------ Timezones -------------------------
+
+	bench(options, "get_timezone/time_t", NULL, NAN, 1, [=](long i) {
+		sink = PrayerTimes::get_timezone(now + (i % 365) * 86400);
+	});
+
+	bench(options, "get_timezone/date", NULL, NAN, 1, [](long i) {
+		sink = PrayerTimes::get_timezone(2024, 1 + i % 12, 1 + i % 28);
+	});
+
+	printf("\n  ]\n}\n");
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*-------------------- In the name of God ----------------------*\
+
+    City database tool
+    Builds a city database from a GeoNames dump and searches it
+
+    Part of PrayerTimes, see prayertimes.cpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "citydb.hpp"
+
+using prayertimes::City;
+using prayertimes::CityDatabase;
+using prayertimes::CityRecord;
+
+// Columns of the GeoNames geoname table
+enum
+{
+	GEONAMES_NAME = 1,
+	GEONAMES_ASCII_NAME = 2,
+	GEONAMES_ALTERNATE_NAMES = 3,
+	GEONAMES_LATITUDE = 4,
+	GEONAMES_LONGITUDE = 5,
+	GEONAMES_FEATURE_CLASS = 6,
+	GEONAMES_COUNTRY = 8,
+	GEONAMES_POPULATION = 14,
+	GEONAMES_ELEVATION = 15,
+	GEONAMES_DEM = 16,
+	GEONAMES_TIMEZONE = 17,
+	GEONAMES_COLUMNS = 19,
+};
+
+static void print_help(FILE* f, const char* program)
+{
+	fprintf(f, "Usage: %s [options]\n"
+			"  Build a city database from a GeoNames dump such as cities500.txt, or\n"
+			"  search one\n"
+			"\n"
+			"    --build arg            -b  GeoNames file to build the database from\n"
+			"    --output arg           -o  database file to write\n"
+			"    --min-population arg   -m  leave out smaller places (default 0)\n"
+			"    --no-alternate-names   -N  only index the main names of places\n"
+			"    --database arg         -d  database file to search\n"
+			"    --search arg           -s  list the cities whose name starts with arg\n"
+			"    --limit arg            -n  maximum number of cities listed (default 10)\n"
+			"    --help                 -h  display this message\n",
+			program);
+}
+
+// Split a line into its tab separated fields, in place
+static size_t split_fields(char* line, char* fields[], size_t max)
+{
+	size_t count = 0;
+	char* p = line;
+	while (count < max)
+	{
+		fields[count++] = p;
+		p = strchr(p, '\t');
+		if (!p)
+			break;
+		*p++ = '\0';
+	}
+	return count;
+}
+
+// Read the populated places of a GeoNames dump
+static bool read_geonames(const char* path, long min_population, bool alternate_names, std::vector<City>& cities)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+		return false;
+
+	std::string line;
+	char buffer[4096];
+	while (fgets(buffer, sizeof(buffer), file))
+	{
+		line += buffer;
+		if (line.empty() || (line[line.size() - 1] != '\n' && !feof(file)))
+			continue;		// Alternate names make long lines
+		while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+			line.erase(line.size() - 1);
+
+		std::vector<char> text(line.begin(), line.end());
+		text.push_back('\0');
+		line.clear();
+		char* fields[GEONAMES_COLUMNS];
+		if (split_fields(&text[0], fields, GEONAMES_COLUMNS) < GEONAMES_TIMEZONE + 1 ||
+				strcmp(fields[GEONAMES_FEATURE_CLASS], "P") != 0)
+			continue;
+		long population = atol(fields[GEONAMES_POPULATION]);
+		if (population < min_population)
+			continue;
+
+		City city;
+		city.name = fields[GEONAMES_NAME];
+		city.latitude = atof(fields[GEONAMES_LATITUDE]);
+		city.longitude = atof(fields[GEONAMES_LONGITUDE]);
+		city.elevation = *fields[GEONAMES_ELEVATION] ? atof(fields[GEONAMES_ELEVATION]) :
+			atof(fields[GEONAMES_DEM]);
+		if (city.elevation < -1000.0)		// No data
+			city.elevation = 0.0;
+		city.country = fields[GEONAMES_COUNTRY];
+		city.timezone = fields[GEONAMES_TIMEZONE];
+		city.population = population;
+		city.alternate_names.push_back(fields[GEONAMES_ASCII_NAME]);
+		if (alternate_names)
+			for (char* name = strtok(fields[GEONAMES_ALTERNATE_NAMES], ","); name; name = strtok(NULL, ","))
+				if (strncmp(name, "http", 4) != 0)
+					city.alternate_names.push_back(name);
+		cities.push_back(city);
+	}
+
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* build_path = NULL;
+	const char* output_path = NULL;
+	const char* database_path = NULL;
+	const char* query = NULL;
+	long min_population = 0;
+	bool alternate_names = true;
+	int limit = 10;
+
+	static struct option long_options[] =
+	{
+		{ "build",              required_argument, NULL, 'b' },
+		{ "output",             required_argument, NULL, 'o' },
+		{ "min-population",     required_argument, NULL, 'm' },
+		{ "no-alternate-names", no_argument,       NULL, 'N' },
+		{ "database",           required_argument, NULL, 'd' },
+		{ "search",             required_argument, NULL, 's' },
+		{ "limit",              required_argument, NULL, 'n' },
+		{ "help",               no_argument,       NULL, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	for (;;)
+	{
+		int c = getopt_long(argc, argv, "b:o:m:Nd:s:n:h", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+			case 'b':
+				build_path = optarg;
+				break;
+			case 'o':
+				output_path = optarg;
+				break;
+			case 'm':
+				min_population = atol(optarg);
+				break;
+			case 'N':
+				alternate_names = false;
+				break;
+			case 'd':
+				database_path = optarg;
+				break;
+			case 's':
+				query = optarg;
+				break;
+			case 'n':
+				limit = atoi(optarg);
+				break;
+			case 'h':
+				print_help(stdout, argv[0]);
+				return 0;
+			default:
+				print_help(stderr, argv[0]);
+				return 2;
+		}
+	}
+
+	if (build_path)
+	{
+		if (!output_path)
+		{
+			fprintf(stderr, "Error: You must provide an output file\n");
+			return 2;
+		}
+		std::vector<City> cities;
+		if (!read_geonames(build_path, min_population, alternate_names, cities))
+		{
+			fprintf(stderr, "Error: Cannot read '%s'\n", build_path);
+			return 2;
+		}
+		if (!prayertimes::write_city_database(output_path, cities))
+		{
+			fprintf(stderr, "Error: Cannot write '%s'\n", output_path);
+			return 2;
+		}
+		fprintf(stderr, "%zu cities written\n", cities.size());
+		return 0;
+	}
+
+	if (!database_path || !query)
+	{
+		print_help(stderr, argv[0]);
+		return 2;
+	}
+	if (limit <= 0)
+	{
+		fprintf(stderr, "Error: Invalid limit\n");
+		return 2;
+	}
+
+	CityDatabase database;
+	if (!database.open(database_path))
+	{
+		fprintf(stderr, "Error: Cannot open city database '%s'\n", database_path);
+		return 2;
+	}
+
+	std::vector<uint32_t> results(limit);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t count = database.search(query, &results[0], limit);
+	std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const CityRecord& city = database.city(results[i]);
+		printf("%s\t%.2s\t%.5f\t%.5f\t%d\t%s\t%u\n", database.name(city), city.country,
+				city.latitude, city.longitude, city.elevation, database.timezone(city), city.population);
+	}
+	fprintf(stderr, "%zu cities found in %.1f us\n", count, elapsed.count());
+	return 0;
+}
@@ -0,0 +1,679 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Offline city database with a name prefix index
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_CITYDB_HPP
+#define PRAYERTIMES_CITYDB_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "prayertimes.hpp"
+#include "tzfile.hpp"
+
+namespace prayertimes
+{
+
+/* ----------------------- File Format ----------------------- */
+
+// A city database file is made of a header, the cities, an index of their
+// names, an index of their positions and a pool of NUL-terminated strings:
+//
+//   CityDatabaseHeader
+//   CityRecord[city_count]
+//   CityName[name_count]       // Sorted by key, then by decreasing population
+//   uint32_t block_populations[(name_count + CITY_BLOCK_NAMES - 1) / CITY_BLOCK_NAMES]
+//   CityPoint[city_count]      // k-d tree
+//   char strings[strings_size]
+//
+// Each city is indexed under its name and its alternate names, as keys
+// normalized by normalize_city_name(). Names starting with a prefix are
+// then a contiguous range of the index, found by binary search. The
+// population is repeated in the index so that ranking a range only reads
+// it sequentially, and the largest population of each block of
+// CITY_BLOCK_NAMES names lets ranking skip blocks that can't make it into
+// the results, as most of the range of a short prefix.
+//
+// Positions are points on the unit sphere, so that the straight line
+// distance between two of them grows with their distance along the
+// surface. They form an implicit k-d tree: the middle point of a range
+// splits it on x, y or z for depths 0, 1 and 2 modulo 3, the points before
+// it lying below it on that axis and the ones after it above. Values are
+// in host byte order, checked by byte_order.
+
+enum
+{
+	CITY_DATABASE_VERSION = 2,
+	CITY_DATABASE_BYTE_ORDER = 0x01020304,
+	CITY_NAME_MAX = 256,		// Bytes of a normalized name, including its NUL
+	CITY_BLOCK_NAMES = 64,
+};
+
+struct CityDatabaseHeader
+{
+	char magic[8];			// "PRCITY\0\0"
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t city_count;
+	uint32_t name_count;
+	uint64_t cities_offset;
+	uint64_t names_offset;
+	uint64_t blocks_offset;
+	uint64_t points_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+};
+
+struct CityRecord
+{
+	float latitude;
+	float longitude;
+	int16_t elevation;		// In meters
+	char country[2];		// ISO 3166 code
+	uint32_t population;
+	uint32_t name;			// Offsets in strings
+	uint32_t timezone;
+};
+
+struct CityName
+{
+	uint32_t key;			// Offset in strings of the normalized name
+	uint32_t city;
+	uint32_t population;
+};
+
+struct CityPoint
+{
+	float position[3];		// On the unit sphere
+	uint32_t city;
+};
+
+// Mean radius of the Earth in meters
+static const double CITY_EARTH_RADIUS = 6371008.8;
+
+// Point of the unit sphere at a latitude and longitude in degrees
+inline void city_position(double latitude, double longitude, double position[3])
+{
+	double phi = latitude * M_PI / 180.0;
+	double lambda = longitude * M_PI / 180.0;
+	position[0] = cos(phi) * cos(lambda);
+	position[1] = cos(phi) * sin(lambda);
+	position[2] = sin(phi);
+}
+
+// Normalize a city name for the index: ASCII letters are lowercased, other
+// ASCII characters but digits become spaces, and runs of spaces are
+// collapsed. Leading spaces are dropped, and trailing ones too unless
+// keep_trailing_space, so that a query typed up to a space only matches
+// names having more words. Bytes of other UTF-8 characters are kept.
+// Returns the length of the result, truncated to fit size.
+inline size_t normalize_city_name(const char* name, char* out, size_t size, bool keep_trailing_space = false)
+{
+	size_t length = 0;
+	bool space = false;
+	for (const unsigned char* p = (const unsigned char*) name; *p && length + 1 < size; ++p)
+	{
+		unsigned char c = *p;
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		else if (c < 0x80 && !(c >= 'a' && c <= 'z') && !(c >= '0' && c <= '9'))
+		{
+			space = length > 0;
+			continue;
+		}
+		if (space && length + 2 < size)
+			out[length++] = ' ';
+		space = false;
+		out[length++] = c;
+	}
+	if (space && keep_trailing_space && length + 1 < size)
+		out[length++] = ' ';
+	if (size > 0)
+		out[length] = '\0';
+	return length;
+}
+
+//------------------------- City Database Reader --------------------------
+
+// Read-only view of a memory-mapped city database. Opening only checks the
+// header, and searches neither parse nor allocate, so they may be done from
+// any number of threads.
+class CityDatabase
+{
+public:
+	CityDatabase() : map(NULL), map_size(0), header(NULL)
+	{
+	}
+
+	~CityDatabase()
+	{
+		close();
+	}
+
+	// Map a city database file, returning false if it can't be used
+	bool open(const char* path)
+	{
+		close();
+
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CityDatabaseHeader))
+		{
+			::close(fd);
+			return false;
+		}
+		void* address = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (address == MAP_FAILED)
+			return false;
+
+		map = static_cast<const char*>(address);
+		map_size = st.st_size;
+		header = reinterpret_cast<const CityDatabaseHeader*>(map);
+		if (!valid())
+		{
+			close();
+			return false;
+		}
+		cities = reinterpret_cast<const CityRecord*>(map + header->cities_offset);
+		names = reinterpret_cast<const CityName*>(map + header->names_offset);
+		block_populations = reinterpret_cast<const uint32_t*>(map + header->blocks_offset);
+		points = reinterpret_cast<const CityPoint*>(map + header->points_offset);
+		strings = map + header->strings_offset;
+		return true;
+	}
+
+	void close()
+	{
+		if (map)
+			munmap(const_cast<char*>(map), map_size);
+		map = NULL;
+		map_size = 0;
+		header = NULL;
+	}
+
+	bool is_open() const
+	{
+		return header != NULL;
+	}
+
+	size_t city_count() const
+	{
+		return header->city_count;
+	}
+
+	const CityRecord& city(size_t index) const
+	{
+		return cities[index];
+	}
+
+	const char* name(const CityRecord& city) const
+	{
+		return string(city.name);
+	}
+
+	const char* timezone(const CityRecord& city) const
+	{
+		return string(city.timezone);
+	}
+
+	// Find the cities having a name starting with query, storing the
+	// indices of at most max of them in results. Cities whose whole name
+	// matches come first, then the most populated ones. Returns the number
+	// of cities found.
+	size_t search(const char* query, uint32_t results[], size_t max) const
+	{
+		char prefix[CITY_NAME_MAX];
+		size_t length = normalize_city_name(query, prefix, sizeof(prefix), true);
+		if (length == 0 || max == 0)
+			return 0;
+
+		// Names starting with the prefix
+		size_t first = lower_bound(prefix, length, false);
+		size_t last = lower_bound(prefix, length, true);
+
+		// Keep the best matches, ranked by rank(), best first
+		uint64_t ranks[CITY_SEARCH_MAX];
+		if (max > CITY_SEARCH_MAX)
+			max = CITY_SEARCH_MAX;
+		size_t count = 0;
+		for (size_t i = first; i < last; ++i)
+		{
+			// Whole name matches sort first, the rest of the range can only
+			// make it through its populations
+			const CityName& entry = names[i];
+			bool exact = string(entry.key)[length] == '\0';
+			if (!exact && count == max && i % CITY_BLOCK_NAMES == 0 &&
+					rank(false, block_populations[i / CITY_BLOCK_NAMES]) <= ranks[count - 1])
+			{
+				i += CITY_BLOCK_NAMES - 1;
+				continue;
+			}
+			uint64_t entry_rank = rank(exact, entry.population);
+			if (count == max && entry_rank <= ranks[count - 1])
+				continue;
+
+			// A city matching by several names keeps its best rank
+			size_t j = 0;
+			while (j < count && results[j] != entry.city)
+				++j;
+			if (j < count)
+			{
+				if (entry_rank <= ranks[j])
+					continue;
+				for (; j + 1 < count; ++j)
+				{
+					results[j] = results[j + 1];
+					ranks[j] = ranks[j + 1];
+				}
+				--count;
+			}
+			else if (count == max)
+				--count;
+
+			for (j = count; j > 0 && ranks[j - 1] < entry_rank; --j)
+			{
+				results[j] = results[j - 1];
+				ranks[j] = ranks[j - 1];
+			}
+			results[j] = entry.city;
+			ranks[j] = entry_rank;
+			++count;
+		}
+		return count;
+	}
+
+	// Find the cities nearest to a point, storing the indices of at most
+	// max of them in results, nearest first, and their distances in meters
+	// in distances if not NULL. Only cities within radius meters are
+	// considered. Returns the number of cities found.
+	size_t find_nearest(double latitude, double longitude, uint32_t results[], size_t max,
+			double radius = HUGE_VAL, double distances[] = NULL) const
+	{
+		double squares[CITY_SEARCH_MAX];
+		NearestQuery query;
+		city_position(latitude, longitude, query.position);
+		double chord = radius >= M_PI * CITY_EARTH_RADIUS ? 2.0 :
+			2.0 * sin(std::max(radius, 0.0) / (2.0 * CITY_EARTH_RADIUS));
+		query.max_square = chord * chord;
+		query.results = results;
+		query.squares = squares;
+		query.max = max > CITY_SEARCH_MAX ? CITY_SEARCH_MAX : max;
+		query.count = 0;
+
+		double offsets[3] = { 0.0, 0.0, 0.0 };
+		if (query.max > 0)
+			find_nearest(query, 0, header->city_count, 0, 0.0, offsets);
+		for (size_t i = 0; distances && i < query.count; ++i)
+			distances[i] = 2.0 * CITY_EARTH_RADIUS * asin(std::min(sqrt(squares[i]) / 2.0, 1.0));
+		return query.count;
+	}
+
+	// Index of the city nearest to a point, or -1 if there is none within
+	// radius meters
+	long find_nearest(double latitude, double longitude, double radius = HUGE_VAL,
+			double* distance = NULL) const
+	{
+		uint32_t result;
+		return find_nearest(latitude, longitude, &result, 1, radius, distance) ? (long) result : -1;
+	}
+
+	static const size_t CITY_SEARCH_MAX = 100;		// Maximum results of a search
+
+private:
+	CityDatabase(const CityDatabase&);
+	CityDatabase& operator=(const CityDatabase&);
+
+	// State of a nearest cities search, whose results are kept sorted by
+	// increasing square distance
+	struct NearestQuery
+	{
+		double position[3];
+		double max_square;
+		uint32_t* results;
+		double* squares;
+		size_t max;
+		size_t count;
+	};
+
+	// Search the subtree of points [first, last) splitting on axis. The
+	// subtree lies beyond the splitting planes of its ancestors, offsets
+	// holding the distance along each axis from the query to the nearest of
+	// them on its side, and bound the sum of their squares: no point of the
+	// subtree can be closer.
+	void find_nearest(NearestQuery& query, size_t first, size_t last, int axis, double bound,
+			double offsets[3]) const
+	{
+		if (first >= last || bound > query.max_square)
+			return;
+
+		size_t middle = first + (last - first) / 2;
+		const CityPoint& point = points[middle];
+
+		double square = 0.0;
+		for (int i = 0; i < 3; ++i)
+		{
+			double d = point.position[i] - query.position[i];
+			square += d * d;
+		}
+		if (square <= query.max_square)
+			add_nearest(query, point.city, square);
+
+		// Search the side of the query first, then the other one if the
+		// splitting plane is close enough
+		double offset = query.position[axis] - point.position[axis];
+		int next_axis = axis == 2 ? 0 : axis + 1;
+		if (offset < 0)
+			find_nearest(query, first, middle, next_axis, bound, offsets);
+		else
+			find_nearest(query, middle + 1, last, next_axis, bound, offsets);
+
+		double saved_offset = offsets[axis];
+		bound += offset * offset - saved_offset * saved_offset;
+		offsets[axis] = offset;
+		if (offset < 0)
+			find_nearest(query, middle + 1, last, next_axis, bound, offsets);
+		else
+			find_nearest(query, first, middle, next_axis, bound, offsets);
+		offsets[axis] = saved_offset;
+	}
+
+	static void add_nearest(NearestQuery& query, uint32_t city, double square)
+	{
+		size_t j = query.count < query.max ? query.count++ : query.max - 1;
+		for (; j > 0 && query.squares[j - 1] > square; --j)
+		{
+			query.results[j] = query.results[j - 1];
+			query.squares[j] = query.squares[j - 1];
+		}
+		query.results[j] = city;
+		query.squares[j] = square;
+
+		// Once full, only nearer cities are of interest
+		if (query.count == query.max)
+			query.max_square = query.squares[query.count - 1];
+	}
+
+	// First name whose key isn't before prefix, or if after_prefix, which
+	// doesn't start with it either
+	size_t lower_bound(const char* prefix, size_t length, bool after_prefix) const
+	{
+		size_t low = 0, high = header->name_count;
+		while (low < high)
+		{
+			size_t middle = (low + high) / 2;
+			int order = strncmp(string(names[middle].key), prefix, length);
+			if (order < 0 || (order == 0 && after_prefix))
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		return low;
+	}
+
+	static uint64_t block_count(uint64_t names)
+	{
+		return (names + CITY_BLOCK_NAMES - 1) / CITY_BLOCK_NAMES;
+	}
+
+	static uint64_t rank(bool exact, uint32_t population)
+	{
+		return ((uint64_t) exact << 32) | population;
+	}
+
+	const char* string(uint32_t offset) const
+	{
+		return offset < header->strings_size ? strings + offset : "";
+	}
+
+	// Check the header, that the data it describes fits in the file and
+	// that the last string is terminated
+	bool valid() const
+	{
+		if (memcmp(header->magic, "PRCITY\0", 8) != 0 || header->version != CITY_DATABASE_VERSION ||
+				header->byte_order != CITY_DATABASE_BYTE_ORDER)
+			return false;
+		return header->cities_offset + (uint64_t) header->city_count * sizeof(CityRecord) <= map_size &&
+			header->names_offset + (uint64_t) header->name_count * sizeof(CityName) <= map_size &&
+			header->blocks_offset + block_count(header->name_count) * sizeof(uint32_t) <= map_size &&
+			header->points_offset + (uint64_t) header->city_count * sizeof(CityPoint) <= map_size &&
+			header->strings_offset + header->strings_size <= map_size &&
+			header->strings_size > 0 && map[header->strings_offset + header->strings_size - 1] == '\0';
+	}
+
+	const char* map;
+	size_t map_size;
+	const CityDatabaseHeader* header;
+	const CityRecord* cities;
+	const CityName* names;
+	const uint32_t* block_populations;
+	const CityPoint* points;
+	const char* strings;
+};
+
+// Timezones of locations taken from the nearest city of a database. Once
+// built the resolver is never modified, so lookups are thread-safe. The
+// database must stay open as long as the resolver is used.
+class CityTimeZones : public TimeZoneResolver
+{
+public:
+	// Timezones of the cities are looked up in cache once for all
+	CityTimeZones(const CityDatabase& database, TimeZoneCache& cache = TimeZoneCache::shared()) :
+		database(database)
+	{
+		for (size_t c = 0; database.is_open() && c < database.city_count(); ++c)
+		{
+			const CityRecord& city = database.city(c);
+			if (zones.find(city.timezone) == zones.end())
+				zones[city.timezone] = cache.get(database.timezone(city));
+		}
+	}
+
+	// Get the timezone in hours of a point on a Gregorian date. Points whose
+	// nearest city has no known timezone get the nautical timezone of their
+	// longitude.
+	double get_timezone(double latitude, double longitude, int year, int month, int day) const
+	{
+		long c = database.is_open() ? database.find_nearest(latitude, longitude) : -1;
+		if (c >= 0)
+		{
+			std::map<uint32_t, const TimeZone*>::const_iterator it = zones.find(database.city(c).timezone);
+			if (it != zones.end() && it->second)
+				return it->second->get_timezone(year, month, day);
+		}
+		return ::floor(longitude / 15.0 + 0.5);
+	}
+
+private:
+	const CityDatabase& database;
+	std::map<uint32_t, const TimeZone*> zones;		// By offset of their names in the database
+};
+
+//------------------------- City Database Writer --------------------------
+
+// City to write in a database
+struct City
+{
+	std::string name;
+	std::vector<std::string> alternate_names;
+	double latitude;
+	double longitude;
+	double elevation;
+	std::string country;
+	std::string timezone;
+	uint32_t population;
+};
+
+// Write cities as a city database file. Returns false on I/O errors.
+inline bool write_city_database(const char* path, const std::vector<City>& cities)
+{
+	struct Entry
+	{
+		std::string key;
+		uint32_t city;
+		uint32_t population;
+
+		bool operator<(const Entry& other) const
+		{
+			return key != other.key ? key < other.key : population > other.population;
+		}
+	};
+
+	// Shared strings are stored once
+	std::string strings(1, '\0');
+	std::map<std::string, uint32_t> offsets;
+	struct Pool
+	{
+		std::string& strings;
+		std::map<std::string, uint32_t>& offsets;
+
+		uint32_t add(const std::string& value)
+		{
+			std::map<std::string, uint32_t>::iterator it = offsets.find(value);
+			if (it != offsets.end())
+				return it->second;
+			uint32_t offset = strings.size();
+			strings.append(value.c_str(), value.size() + 1);
+			offsets[value] = offset;
+			return offset;
+		}
+	} pool = { strings, offsets };
+
+	std::vector<CityRecord> records(cities.size());
+	std::vector<Entry> entries;
+	for (size_t c = 0; c < cities.size(); ++c)
+	{
+		const City& city = cities[c];
+		CityRecord& record = records[c];
+		memset(&record, 0, sizeof(record));
+		record.latitude = city.latitude;
+		record.longitude = city.longitude;
+		record.elevation = city.elevation < INT16_MIN ? INT16_MIN : city.elevation > INT16_MAX ? INT16_MAX :
+			(int16_t) city.elevation;
+		memcpy(record.country, city.country.c_str(), std::min<size_t>(city.country.size(), 2));
+		record.population = city.population;
+		record.name = pool.add(city.name);
+		record.timezone = pool.add(city.timezone);
+
+		// Each distinct key of a city is indexed once
+		std::vector<std::string> keys;
+		for (size_t n = 0; n <= city.alternate_names.size(); ++n)
+		{
+			char key[CITY_NAME_MAX];
+			if (normalize_city_name(n == 0 ? city.name.c_str() : city.alternate_names[n - 1].c_str(),
+						key, sizeof(key)) == 0 || std::find(keys.begin(), keys.end(), key) != keys.end())
+				continue;
+			keys.push_back(key);
+			Entry entry = { key, (uint32_t) c, city.population };
+			entries.push_back(entry);
+		}
+	}
+	std::sort(entries.begin(), entries.end());
+
+	std::vector<CityName> names(entries.size());
+	std::vector<uint32_t> block_populations((entries.size() + CITY_BLOCK_NAMES - 1) / CITY_BLOCK_NAMES);
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		names[i].key = pool.add(entries[i].key);
+		names[i].city = entries[i].city;
+		names[i].population = entries[i].population;
+		uint32_t& block_population = block_populations[i / CITY_BLOCK_NAMES];
+		block_population = std::max(block_population, entries[i].population);
+	}
+
+	// Sort the positions into a k-d tree, splitting each range at its middle
+	std::vector<CityPoint> points(cities.size());
+	for (size_t c = 0; c < cities.size(); ++c)
+	{
+		double position[3];
+		city_position(cities[c].latitude, cities[c].longitude, position);
+		for (int i = 0; i < 3; ++i)
+			points[c].position[i] = position[i];
+		points[c].city = c;
+	}
+	struct Range
+	{
+		size_t first;
+		size_t last;
+		int axis;
+	};
+	struct AxisOrder
+	{
+		int axis;
+
+		bool operator()(const CityPoint& a, const CityPoint& b) const
+		{
+			return a.position[axis] < b.position[axis];
+		}
+	};
+	std::vector<Range> ranges(1);
+	ranges[0].first = 0;
+	ranges[0].last = points.size();
+	ranges[0].axis = 0;
+	while (!ranges.empty())
+	{
+		Range range = ranges.back();
+		ranges.pop_back();
+		if (range.last - range.first < 2)
+			continue;
+		size_t middle = range.first + (range.last - range.first) / 2;
+		AxisOrder order = { range.axis };
+		std::nth_element(points.begin() + range.first, points.begin() + middle, points.begin() + range.last, order);
+		int next_axis = range.axis == 2 ? 0 : range.axis + 1;
+		Range below = { range.first, middle, next_axis };
+		Range above = { middle + 1, range.last, next_axis };
+		ranges.push_back(below);
+		ranges.push_back(above);
+	}
+
+	CityDatabaseHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "PRCITY\0", 8);
+	header.version = CITY_DATABASE_VERSION;
+	header.byte_order = CITY_DATABASE_BYTE_ORDER;
+	header.city_count = records.size();
+	header.name_count = names.size();
+	header.cities_offset = sizeof(header);
+	header.names_offset = header.cities_offset + records.size() * sizeof(CityRecord);
+	header.blocks_offset = header.names_offset + names.size() * sizeof(CityName);
+	header.points_offset = header.blocks_offset + block_populations.size() * sizeof(uint32_t);
+	header.strings_offset = header.points_offset + points.size() * sizeof(CityPoint);
+	header.strings_size = strings.size();
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(records.data(), sizeof(CityRecord), records.size(), file) == records.size() &&
+		fwrite(names.data(), sizeof(CityName), names.size(), file) == names.size() &&
+		fwrite(block_populations.data(), sizeof(uint32_t), block_populations.size(), file) ==
+			block_populations.size() &&
+		fwrite(points.data(), sizeof(CityPoint), points.size(), file) == points.size() &&
+		fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok)
+		remove(path);
+	return ok;
+}
+
+}
+
+#endif /* PRAYERTIMES_CITYDB_HPP */
@@ -0,0 +1,269 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Elevations from SRTM elevation tiles
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_DEM_HPP
+#define PRAYERTIMES_DEM_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <algorithm>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "prayertimes.hpp"
+
+namespace prayertimes
+{
+
+// Elevations read from a directory of SRTM height tiles, the .hgt files
+// of one degree squares named after their south west corner such as
+// N48E002.hgt. A tile is a square grid of 1201 (3 arc seconds) or 3601
+// (1 arc second) rows of big-endian 16-bit heights in meters, from north to
+// south, whose edges overlap those of the next tiles.
+//
+// Tiles are memory-mapped when first needed, and the ones used least
+// recently are unmapped once more than max_tiles are open, so only the
+// pages of the grid around looked up points are ever read. Elevations are
+// interpolated between the four samples around a point, leaving out
+// voids. Lookups are serialized by a mutex, so a map may be shared by
+// threads, except while it is opened or closed. A map with no directory
+// open answers NAN without locking. As an ElevationResolver, it lets
+// PrayerTimes find the elevation of locations given without one.
+class ElevationMap : public ElevationResolver
+{
+public:
+	ElevationMap(size_t max_tiles = 16) : max_tiles(max_tiles > 0 ? max_tiles : 1), clock(0)
+	{
+	}
+
+	~ElevationMap()
+	{
+		close();
+	}
+
+	// Use the tiles of a directory, returning false if it isn't one
+	bool open(const std::string& new_directory)
+	{
+		close();
+		struct stat st;
+		if (stat(new_directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+			return false;
+		directory = new_directory;
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < tiles.size(); ++i)
+			munmap(const_cast<unsigned char*>(tiles[i].data), tiles[i].size);
+		tiles.clear();
+		missing.clear();
+		directory.clear();
+	}
+
+	bool is_open() const
+	{
+		return !directory.empty();
+	}
+
+	// Get the elevation in meters of a point, or NAN if its tile is missing
+	// or it lies in a void
+	double get_elevation(double latitude, double longitude) const
+	{
+		if (!is_open())
+			return NAN;
+		std::lock_guard<std::mutex> lock(mutex);
+		return sample(latitude, longitude);
+	}
+
+	// Get the elevations of many points at once, looking them up tile by
+	// tile so that each tile is mapped once and its pages are read in
+	// order, however the points are sorted
+	void get_elevations(size_t count, const double latitudes[], const double longitudes[],
+			double elevations[]) const
+	{
+		if (!is_open())
+		{
+			for (size_t i = 0; i < count; ++i)
+				elevations[i] = NAN;
+			return;
+		}
+
+		std::vector<std::pair<int64_t, size_t> > order(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			// By tile, then by row and column of the finest grid
+			double latitude = latitudes[i], longitude = normalize_longitude(longitudes[i]);
+			int64_t key = std::isnan(latitude) || std::isnan(longitude) ? INT64_MAX :
+				(int64_t) tile_key(latitude, longitude) << 24 |
+				(int64_t) ((::floor(latitude) + 1.0 - latitude) * 3600.0) << 12 |
+				(int64_t) ((longitude - ::floor(longitude)) * 3600.0);
+			order[i] = std::make_pair(key, i);
+		}
+		std::sort(order.begin(), order.end());
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t j = order[i].second;
+			elevations[j] = sample(latitudes[j], longitudes[j]);
+		}
+	}
+
+private:
+	ElevationMap(const ElevationMap&);
+	ElevationMap& operator=(const ElevationMap&);
+
+	static const int16_t VOID_HEIGHT = -32768;
+
+	struct Tile
+	{
+		int key;
+		const unsigned char* data;
+		size_t size;
+		int samples;		// Per row and per column
+		uint64_t last_used;
+	};
+
+	static double normalize_longitude(double longitude)
+	{
+		return longitude - 360.0 * ::floor((longitude + 180.0) / 360.0);
+	}
+
+	// Key of the tile of a point with a normalized longitude, from the
+	// degrees of its south west corner
+	static int tile_key(double latitude, double longitude)
+	{
+		int south = (int) ::floor(latitude);
+		int west = (int) ::floor(longitude);
+		return (south + 90) * 360 + (west + 180);
+	}
+
+	// Interpolate the elevation of a point, the mutex being locked
+	double sample(double latitude, double longitude) const
+	{
+		if (directory.empty() || std::isnan(latitude) || std::isnan(longitude) ||
+				latitude < -90.0 || latitude > 90.0)
+			return NAN;
+		longitude = normalize_longitude(longitude);
+		if (latitude == 90.0)
+			latitude = ::nextafter(90.0, 0.0);
+
+		const Tile* tile = get_tile(tile_key(latitude, longitude));
+		if (!tile)
+			return NAN;
+
+		// Grid coordinates of the point, rows going south
+		int last = tile->samples - 1;
+		double y = (::floor(latitude) + 1.0 - latitude) * last;
+		double x = (longitude - ::floor(longitude)) * last;
+		int row = std::min((int) y, last - 1);
+		int column = std::min((int) x, last - 1);
+		double dy = y - row, dx = x - column;
+
+		double sum = 0.0, weights = 0.0;
+		for (int r = 0; r < 2; ++r)
+			for (int c = 0; c < 2; ++c)
+			{
+				const unsigned char* p = tile->data + 2 * ((size_t) (row + r) * tile->samples + column + c);
+				int16_t height = (int16_t) (p[0] << 8 | p[1]);
+				double weight = (r ? dy : 1.0 - dy) * (c ? dx : 1.0 - dx);
+				if (height == VOID_HEIGHT || weight <= 0.0)
+					continue;
+				sum += weight * height;
+				weights += weight;
+			}
+		return weights > 0.0 ? sum / weights : NAN;
+	}
+
+	// Find a tile, mapping it if it isn't, or return NULL if it is missing
+	const Tile* get_tile(int key) const
+	{
+		++clock;
+		for (size_t i = 0; i < tiles.size(); ++i)
+			if (tiles[i].key == key)
+			{
+				tiles[i].last_used = clock;
+				return &tiles[i];
+			}
+		if (missing.count(key))
+			return NULL;
+
+		Tile tile;
+		if (!map_tile(key, tile))
+		{
+			missing.insert(key);
+			return NULL;
+		}
+		tile.last_used = clock;
+
+		// Replace the tile used least recently
+		if (tiles.size() < max_tiles)
+		{
+			tiles.push_back(tile);
+			return &tiles.back();
+		}
+		size_t oldest = 0;
+		for (size_t i = 1; i < tiles.size(); ++i)
+			if (tiles[i].last_used < tiles[oldest].last_used)
+				oldest = i;
+		munmap(const_cast<unsigned char*>(tiles[oldest].data), tiles[oldest].size);
+		tiles[oldest] = tile;
+		return &tiles[oldest];
+	}
+
+	bool map_tile(int key, Tile& tile) const
+	{
+		int south = key / 360 - 90;
+		int west = key % 360 - 180;
+		char name[32];
+		snprintf(name, sizeof(name), "/%c%02d%c%03d.hgt", south < 0 ? 'S' : 'N', std::abs(south),
+				west < 0 ? 'W' : 'E', std::abs(west));
+
+		int fd = ::open((directory + name).c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		int samples = 0;
+		if (fstat(fd, &st) == 0)
+			for (int n = 1201; n <= 3601 && !samples; n += 2400)
+				if ((size_t) st.st_size == (size_t) n * n * 2)
+					samples = n;
+		void* address = samples ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+		::close(fd);
+		if (address == MAP_FAILED)
+			return false;
+
+		tile.key = key;
+		tile.data = static_cast<const unsigned char*>(address);
+		tile.size = st.st_size;
+		tile.samples = samples;
+		return true;
+	}
+
+	std::string directory;
+	size_t max_tiles;
+	mutable std::mutex mutex;
+	mutable std::vector<Tile> tiles;
+	mutable std::set<int> missing;		// Keys of tiles known not to exist
+	mutable uint64_t clock;		// Counts lookups, to find the tile used least recently
+};
+
+}
+
+#endif /* PRAYERTIMES_DEM_HPP */
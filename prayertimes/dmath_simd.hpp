@@ -0,0 +1,282 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Vectorized degree-based math functions
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_DMATH_SIMD_HPP
+#define PRAYERTIMES_DMATH_SIMD_HPP
+
+#include <cstddef>
+#include <cmath>
+
+// AVX is used when the compiler targets it (-mavx, -mavx2, -march=native),
+// else SSE2, which every x86-64 CPU has. Define PRAYERTIMES_NO_SIMD to only
+// use the portable scalar code.
+#if !defined(PRAYERTIMES_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define PRAYERTIMES_SIMD_AVX
+#elif !defined(PRAYERTIMES_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define PRAYERTIMES_SIMD_SSE2
+#endif
+
+namespace prayertimes
+{
+
+//------------------------ Vector Types -------------------------
+
+// The kernels below are written once against plain double and against
+// these wrappers of SSE2 and AVX registers, which provide the few
+// operations they need. Comparisons return a mask in a register of the
+// same type, consumed by select().
+
+#if defined(PRAYERTIMES_SIMD_AVX)
+
+struct SimdDouble
+{
+	enum { WIDTH = 4 };
+	__m256d v;
+
+	SimdDouble() {}
+	SimdDouble(__m256d v) : v(v) {}
+	SimdDouble(double d) : v(_mm256_set1_pd(d)) {}
+
+	static SimdDouble load(const double* p) { return _mm256_loadu_pd(p); }
+	void store(double* p) const { _mm256_storeu_pd(p, v); }
+};
+
+inline SimdDouble operator+(SimdDouble a, SimdDouble b) { return _mm256_add_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a, SimdDouble b) { return _mm256_sub_pd(a.v, b.v); }
+inline SimdDouble operator*(SimdDouble a, SimdDouble b) { return _mm256_mul_pd(a.v, b.v); }
+inline SimdDouble operator/(SimdDouble a, SimdDouble b) { return _mm256_div_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+inline SimdDouble operator<(SimdDouble a, SimdDouble b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+inline SimdDouble operator>(SimdDouble a, SimdDouble b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+inline SimdDouble select(SimdDouble mask, SimdDouble a, SimdDouble b) { return _mm256_blendv_pd(b.v, a.v, mask.v); }
+inline SimdDouble simd_abs(SimdDouble a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+inline SimdDouble simd_sqrt(SimdDouble a) { return _mm256_sqrt_pd(a.v); }
+
+#elif defined(PRAYERTIMES_SIMD_SSE2)
+
+struct SimdDouble
+{
+	enum { WIDTH = 2 };
+	__m128d v;
+
+	SimdDouble() {}
+	SimdDouble(__m128d v) : v(v) {}
+	SimdDouble(double d) : v(_mm_set1_pd(d)) {}
+
+	static SimdDouble load(const double* p) { return _mm_loadu_pd(p); }
+	void store(double* p) const { _mm_storeu_pd(p, v); }
+};
+
+inline SimdDouble operator+(SimdDouble a, SimdDouble b) { return _mm_add_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a, SimdDouble b) { return _mm_sub_pd(a.v, b.v); }
+inline SimdDouble operator*(SimdDouble a, SimdDouble b) { return _mm_mul_pd(a.v, b.v); }
+inline SimdDouble operator/(SimdDouble a, SimdDouble b) { return _mm_div_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a) { return _mm_xor_pd(a.v, _mm_set1_pd(-0.0)); }
+inline SimdDouble operator<(SimdDouble a, SimdDouble b) { return _mm_cmplt_pd(a.v, b.v); }
+inline SimdDouble operator>(SimdDouble a, SimdDouble b) { return _mm_cmpgt_pd(a.v, b.v); }
+inline SimdDouble select(SimdDouble mask, SimdDouble a, SimdDouble b)
+{
+	return _mm_or_pd(_mm_and_pd(mask.v, a.v), _mm_andnot_pd(mask.v, b.v));
+}
+inline SimdDouble simd_abs(SimdDouble a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+inline SimdDouble simd_sqrt(SimdDouble a) { return _mm_sqrt_pd(a.v); }
+
+#endif
+
+inline double select(bool mask, double a, double b) { return mask ? a : b; }
+inline double simd_abs(double a) { return ::fabs(a); }
+inline double simd_sqrt(double a) { return ::sqrt(a); }
+
+//------------------------ Math Kernels -------------------------
+
+// Range-reduced polynomial approximations, using the coefficients of
+// fdlibm. The sine and cosine polynomials are within 2^-58 of the true
+// functions over [-pi/4, pi/4], and the arc functions within about one ulp.
+// Measured against glibc over [-720, 720] degrees, sin and cos differ by
+// less than 3e-15. tan differs by less than 1e-14 relatively more than 10
+// degrees away from its poles, but the error grows as the inverse of the
+// distance to a pole: about 1e-13 at 1 degree and 2e-9 at 1e-5 degree,
+// where the rounding of the argument dominates. Over their whole domain,
+// arcsin, arccos, arctan and arctan2 differ by less than 1e-13 degrees.
+// Prayer times computed with them move by less than a microsecond.
+//
+// Rounding relies on the 2^52 + 2^51 trick, so these must not be built with
+// -ffast-math, which would also break the NAN results of arccos out of
+// [-1, 1] that high latitude adjustments depend on.
+
+namespace simd_kernels
+{
+
+template <class V>
+inline V round_nearest(V x)
+{
+	const double magic = 6755399441055744.0;		// 2^52 + 2^51
+	return (x + V(magic)) - V(magic);
+}
+
+// Sine and cosine of degrees, reduced to [-45, 45] degrees exactly
+template <class V>
+inline void sincos(V d, V& s, V& c)
+{
+	V q = round_nearest(d * V(1.0 / 90.0));
+	V r = (d - q * V(90.0)) * V(M_PI / 180.0);
+	V z = r * r;
+
+	V ps = r + r * z * (V(-1.66666666666666324348e-01) + z * (V(8.33333333332248946124e-03) +
+			z * (V(-1.98412698298579493134e-04) + z * (V(2.75573137070700676789e-06) +
+			z * (V(-2.50507602534068634195e-08) + z * V(1.58969099521155010221e-10))))));
+	V pc = V(1.0) - V(0.5) * z + z * z * (V(4.16666666666666019037e-02) + z * (V(-1.38888888888741095749e-03) +
+			z * (V(2.48015872894767294178e-05) + z * (V(-2.75573143513906633035e-07) +
+			z * (V(2.08757232129817482790e-09) + z * V(-1.13596475577881948265e-11))))));
+
+	// Quadrant, as q mod 4 in [0, 4)
+	V m = q - V(4.0) * round_nearest(q * V(0.25) - V(0.375));
+	auto odd = simd_abs(simd_abs(m - V(2.0)) - V(1.0)) < V(0.5);		// m is 1 or 3
+	V sin_value = select(odd, pc, ps);
+	V cos_value = select(odd, ps, pc);
+	s = select(m > V(1.5), -sin_value, sin_value);
+	c = select(simd_abs(m - V(1.5)) < V(1.0), -cos_value, cos_value);
+}
+
+// asin(x) / x - 1 for x^2 = z in [0, 0.25]
+template <class V>
+inline V asin_ratio(V z)
+{
+	V p = z * (V(1.66666666666666657415e-01) + z * (V(-3.25565818622400915405e-01) +
+			z * (V(2.01212532134862925881e-01) + z * (V(-4.00555345006794114027e-02) +
+			z * (V(7.91534994289814532176e-04) + z * V(3.47933107596021167570e-05))))));
+	V q = V(1.0) + z * (V(-2.40339491173441421878e+00) + z * (V(2.02094576023350569471e+00) +
+			z * (V(-6.88283971605453293030e-01) + z * V(7.70381505559019352791e-02))));
+	return p / q;
+}
+
+// Arc sine or arc cosine in radians. Beyond 0.5, asin(x) = pi/2 - 2 asin(s)
+// and acos(x) = 2 asin(s), with s = sqrt((1 - x) / 2).
+template <class V>
+inline V arcsin_arccos(V x, bool cosine)
+{
+	V a = simd_abs(x);
+	auto big = a > V(0.5);
+	V z = select(big, (V(1.0) - a) * V(0.5), x * x);
+	V s = select(big, simd_sqrt(z), x);
+	V p = s + s * asin_ratio(z);
+
+	if (cosine)
+		return select(big, select(x < V(0.0), V(M_PI) - V(2.0) * p, V(2.0) * p), V(M_PI / 2) - p);
+	V large = V(M_PI / 2) - V(2.0) * p;
+	return select(big, select(x < V(0.0), -large, large), p);
+}
+
+// Arc tangent in radians, reduced to [0, tan(pi/8)]
+template <class V>
+inline V arctan(V x)
+{
+	V a = simd_abs(x);
+	auto inverse = a > V(1.0);
+	V t = select(inverse, V(1.0) / a, a);
+	auto shift = t > V(0.41421356237309504880);
+	t = select(shift, (t - V(1.0)) / (t + V(1.0)), t);
+
+	V z = t * t;
+	V w = z * z;
+	V s1 = z * (V(3.33333333333329318027e-01) + w * (V(1.42857142725034663711e-01) +
+			w * (V(9.09088713343650656196e-02) + w * (V(6.66107313738753120669e-02) +
+			w * (V(4.97687799461593236017e-02) + w * V(1.62858201153657823623e-02))))));
+	V s2 = w * (V(-1.99999999998764832476e-01) + w * (V(-1.11111104054623557880e-01) +
+			w * (V(-7.69187620504482999495e-02) + w * (V(-5.83357013379057348645e-02) +
+			w * V(-3.65315727442169155270e-02)))));
+	V r = t - t * (s1 + s2);
+
+	r = select(shift, r + V(M_PI / 4), r);
+	r = select(inverse, V(M_PI / 2) - r, r);
+	return select(x < V(0.0), -r, r);
+}
+
+struct Sin { template <class V> static V eval(V d) { V s, c; sincos(d, s, c); return s; } };
+struct Cos { template <class V> static V eval(V d) { V s, c; sincos(d, s, c); return c; } };
+struct Tan { template <class V> static V eval(V d) { V s, c; sincos(d, s, c); return s / c; } };
+struct ArcSin { template <class V> static V eval(V x) { return arcsin_arccos(x, false) * V(180.0 / M_PI); } };
+struct ArcCos { template <class V> static V eval(V x) { return arcsin_arccos(x, true) * V(180.0 / M_PI); } };
+struct ArcTan { template <class V> static V eval(V x) { return arctan(x) * V(180.0 / M_PI); } };
+struct ArcCot { template <class V> static V eval(V x) { return arctan(V(1.0) / x) * V(180.0 / M_PI); } };
+
+}
+
+//------------------------ Array Functions -------------------------
+
+// Degree-based math functions over arrays, the vectorized counterpart of
+// DMath. Inputs and outputs may be the same array.
+class DMathSimd
+{
+public:
+	static void sin(const double d[], double out[], size_t n) { apply<simd_kernels::Sin>(d, out, n); }
+	static void cos(const double d[], double out[], size_t n) { apply<simd_kernels::Cos>(d, out, n); }
+	static void tan(const double d[], double out[], size_t n) { apply<simd_kernels::Tan>(d, out, n); }
+
+	static void arcsin(const double x[], double out[], size_t n) { apply<simd_kernels::ArcSin>(x, out, n); }
+	static void arccos(const double x[], double out[], size_t n) { apply<simd_kernels::ArcCos>(x, out, n); }
+	static void arctan(const double x[], double out[], size_t n) { apply<simd_kernels::ArcTan>(x, out, n); }
+	static void arccot(const double x[], double out[], size_t n) { apply<simd_kernels::ArcCot>(x, out, n); }
+
+	// Sine and cosine at once, sharing the range reduction
+	static void sincos(const double d[], double s[], double c[], size_t n)
+	{
+		size_t i = 0;
+#if defined(PRAYERTIMES_SIMD_AVX) || defined(PRAYERTIMES_SIMD_SSE2)
+		for (; i + SimdDouble::WIDTH <= n; i += SimdDouble::WIDTH)
+		{
+			SimdDouble vs, vc;
+			simd_kernels::sincos(SimdDouble::load(d + i), vs, vc);
+			vs.store(s + i);
+			vc.store(c + i);
+		}
+#endif
+		for (; i < n; ++i)
+			simd_kernels::sincos(d[i], s[i], c[i]);
+	}
+
+	// Angle of (x, y) in degrees, in [-180, 180]
+	static void arctan2(const double y[], const double x[], double out[], size_t n)
+	{
+		size_t i = 0;
+#if defined(PRAYERTIMES_SIMD_AVX) || defined(PRAYERTIMES_SIMD_SSE2)
+		for (; i + SimdDouble::WIDTH <= n; i += SimdDouble::WIDTH)
+			arctan2(SimdDouble::load(y + i), SimdDouble::load(x + i)).store(out + i);
+#endif
+		for (; i < n; ++i)
+			out[i] = arctan2(y[i], x[i]);
+	}
+
+private:
+	template <class Kernel>
+	static void apply(const double in[], double out[], size_t n)
+	{
+		size_t i = 0;
+#if defined(PRAYERTIMES_SIMD_AVX) || defined(PRAYERTIMES_SIMD_SSE2)
+		for (; i + SimdDouble::WIDTH <= n; i += SimdDouble::WIDTH)
+			Kernel::eval(SimdDouble::load(in + i)).store(out + i);
+#endif
+		for (; i < n; ++i)
+			out[i] = Kernel::eval(in[i]);
+	}
+
+	template <class V>
+	static V arctan2(V y, V x)
+	{
+		V r = simd_kernels::arctan(y / x);
+		V turn = select(y < V(0.0), V(-M_PI), V(M_PI));
+		return select(x < V(0.0), r + turn, r) * V(180.0 / M_PI);
+	}
+};
+
+}
+
+#endif /* PRAYERTIMES_DMATH_SIMD_HPP */
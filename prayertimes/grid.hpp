@@ -0,0 +1,282 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Precomputed geographic grid of prayer times
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_GRID_HPP
+#define PRAYERTIMES_GRID_HPP
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "prayertimes.hpp"
+
+namespace prayertimes
+{
+
+// Prayer times of a date precomputed on a regular latitude/longitude grid,
+// so that times of arbitrary coordinates are found by bilinear
+// interpolation of the four surrounding nodes instead of being computed.
+//
+// The grid is refined until interpolating at the center of every cell is
+// within a target error of the exact times, or until few enough cells miss
+// it: near the latitudes where the sun just reaches an angle times vary too
+// fast for any grid. Cells where the high latitude adjustment kicks in on
+// any corner, where the sun doesn't reach an angle, or which still miss the
+// target are flagged, and lookups falling in them are computed exactly.
+//
+// Times are computed in UTC for a single elevation; the timezone is applied
+// at lookup. A built grid is never modified, so lookups are thread-safe.
+class PrayerGrid
+{
+public:
+	// Build the grid of a date over a region, with a maximum interpolation
+	// error in seconds. Refinement also stops before the grid would exceed
+	// max_nodes nodes, of TimesCount floats each, leaving a larger error.
+	PrayerGrid(const PrayerTimes& prayer_times, int year, int month, int day,
+			double target_error = 30.0, double elevation = 0.0,
+			double min_latitude = -90.0, double max_latitude = 90.0,
+			double min_longitude = -180.0, double max_longitude = 180.0,
+			size_t max_nodes = DEFAULT_MAX_NODES)
+		: engine(prayer_times), year(year), month(month), day(day), elevation(elevation),
+		min_latitude(min_latitude), max_latitude(max_latitude),
+		min_longitude(min_longitude), max_longitude(max_longitude)
+	{
+		ephemeris = SolarEphemeris(PrayerTimes::julian(year, month, day));
+		engine.set_ephemeris(&ephemeris);
+		engine.set_fast_trig(true);
+
+		for (step = INITIAL_STEP; ; step /= 2.0)
+		{
+			build();
+			size_t missed;
+			max_error = measure(target_error, false, missed);
+			if (max_error <= target_error || missed <= exact.size() * MAX_MISSED_SHARE ||
+					step / 2.0 < MIN_STEP || count_nodes(step / 2.0) > max_nodes)
+				break;
+		}
+		size_t missed;
+		max_error = measure(target_error, true, missed);
+	}
+
+	// Copies would share the ephemeris of the original
+	PrayerGrid(const PrayerGrid& other) : engine(other.engine)
+	{
+		*this = other;
+	}
+
+	PrayerGrid& operator=(const PrayerGrid& other)
+	{
+		engine = other.engine;
+		year = other.year;
+		month = other.month;
+		day = other.day;
+		elevation = other.elevation;
+		min_latitude = other.min_latitude;
+		max_latitude = other.max_latitude;
+		min_longitude = other.min_longitude;
+		max_longitude = other.max_longitude;
+		step = other.step;
+		rows = other.rows;
+		columns = other.columns;
+		nodes = other.nodes;
+		exact = other.exact;
+		max_error = other.max_error;
+		ephemeris = other.ephemeris;
+		engine.set_ephemeris(&ephemeris);
+		return *this;
+	}
+
+	// Return prayer times at some coordinates, interpolated when possible
+	// Returns whether times were interpolated rather than computed
+	bool get_prayer_times(double latitude, double longitude, double timezone, double times[]) const
+	{
+		double y = (latitude - min_latitude) / step;
+		double x = (longitude - min_longitude) / step;
+		int i = std::min((int) ::floor(y), rows - 2);
+		int j = std::min((int) ::floor(x), columns - 2);
+
+		if (latitude < min_latitude || latitude > max_latitude ||
+				longitude < min_longitude || longitude > max_longitude ||
+				i < 0 || j < 0 || exact[i * (columns - 1) + j])
+		{
+			Location location = { latitude, longitude, elevation, timezone };
+			engine.get_prayer_times(year, month, day, location, times);
+			return false;
+		}
+
+		interpolate(i, j, y - i, x - j, times);
+		for (int k = 0; k < TimesCount; ++k)
+			times[k] += timezone * 3600.0;
+		return true;
+	}
+
+	// Distance between two nodes, in degrees
+	double get_step() const
+	{
+		return step;
+	}
+
+	// Largest interpolation error observed at the cell centers outside of
+	// flagged cells, in seconds
+	double get_max_error() const
+	{
+		return max_error;
+	}
+
+	// Number of cells computed exactly, and in total
+	size_t get_exact_cells() const
+	{
+		return std::count(exact.begin(), exact.end(), 1);
+	}
+
+	size_t get_cells() const
+	{
+		return exact.size();
+	}
+
+private:
+	static constexpr double INITIAL_STEP = 4.0;		// Coarsest grid, in degrees
+	static constexpr double MIN_STEP = 1.0 / 16.0;		// Finest grid, in degrees
+	static constexpr double MAX_MISSED_SHARE = 1.0 / 64.0;	// Cells allowed to miss the target error
+	static const size_t DEFAULT_MAX_NODES = 1 << 21;		// About 75 MB of nodes, a world grid of 1/4 degree
+
+	// Number of rows and columns of nodes covering the region at a step
+	void grid_size(double grid_step, int& grid_rows, int& grid_columns) const
+	{
+		grid_rows = std::max(2, (int) ::ceil((max_latitude - min_latitude) / grid_step) + 1);
+		grid_columns = std::max(2, (int) ::ceil((max_longitude - min_longitude) / grid_step) + 1);
+	}
+
+	size_t count_nodes(double grid_step) const
+	{
+		int grid_rows, grid_columns;
+		grid_size(grid_step, grid_rows, grid_columns);
+		return (size_t) grid_rows * grid_columns;
+	}
+
+	// Compute the nodes at the current step and flag cells needing exact
+	// computation because of high latitude adjustments
+	void build()
+	{
+		grid_size(step, rows, columns);
+		nodes.assign((size_t) rows * columns * TimesCount, 0.0f);
+		exact.assign((size_t) (rows - 1) * (columns - 1), 0);
+
+		PrayerTimes unadjusted = engine;
+		unadjusted.settings.high_latitudes_method = None;
+
+		std::vector<char> adjusted((size_t) rows * columns);
+		std::vector<double> latitudes(columns), longitudes(columns);
+		std::vector<double> elevations(columns, elevation), timezones(columns, 0.0);
+		std::vector<double> times(columns * TimesCount), plain(columns * TimesCount);
+		for (int j = 0; j < columns; ++j)
+			longitudes[j] = std::min(min_longitude + j * step, 180.0);
+
+		for (int i = 0; i < rows; ++i)
+		{
+			std::fill(latitudes.begin(), latitudes.end(), std::min(min_latitude + i * step, 90.0));
+			engine.get_prayer_times(year, month, day, columns, &latitudes[0], &longitudes[0],
+					&elevations[0], &timezones[0], &times[0]);
+			unadjusted.get_prayer_times(year, month, day, columns, &latitudes[0], &longitudes[0],
+					&elevations[0], &timezones[0], &plain[0]);
+
+			for (int j = 0; j < columns; ++j)
+			{
+				float* node = &nodes[((size_t) i * columns + j) * TimesCount];
+				for (int k = 0; k < TimesCount; ++k)
+				{
+					double time = times[j * TimesCount + k];
+					node[k] = time;
+					if (std::isnan(time) || time != plain[j * TimesCount + k])
+						adjusted[(size_t) i * columns + j] = 1;
+				}
+			}
+		}
+
+		// Nodes past the poles or the antimeridian are clipped to them, so
+		// the cells they end are narrower than interpolate() assumes
+		bool clipped_row = min_latitude + (rows - 1) * step > 90.0;
+		bool clipped_column = min_longitude + (columns - 1) * step > 180.0;
+		for (int i = 0; i < rows - 1; ++i)
+			for (int j = 0; j < columns - 1; ++j)
+				exact[i * (columns - 1) + j] = adjusted[i * columns + j] || adjusted[i * columns + j + 1] ||
+					adjusted[(i + 1) * columns + j] || adjusted[(i + 1) * columns + j + 1] ||
+					(clipped_row && i == rows - 2) || (clipped_column && j == columns - 2);
+	}
+
+	// Find the largest interpolation error at the cell centers, skipping
+	// flagged cells, and count cells exceeding target_error. If flag is set,
+	// those cells get flagged instead of being accounted for.
+	double measure(double target_error, bool flag, size_t& missed)
+	{
+		double worst = 0.0;
+		missed = 0;
+		int cells = columns - 1;
+		std::vector<double> latitudes(cells), longitudes(cells);
+		std::vector<double> elevations(cells, elevation), timezones(cells, 0.0);
+		std::vector<double> times(cells * TimesCount);
+		for (int j = 0; j < cells; ++j)
+			longitudes[j] = std::min(min_longitude + (j + 0.5) * step, 180.0);
+
+		for (int i = 0; i < rows - 1; ++i)
+		{
+			std::fill(latitudes.begin(), latitudes.end(), std::min(min_latitude + (i + 0.5) * step, 90.0));
+			engine.get_prayer_times(year, month, day, cells, &latitudes[0], &longitudes[0],
+					&elevations[0], &timezones[0], &times[0]);
+
+			for (int j = 0; j < cells; ++j)
+			{
+				char& cell_exact = exact[i * cells + j];
+				if (cell_exact)
+					continue;
+
+				double interpolated[TimesCount];
+				interpolate(i, j, 0.5, 0.5, interpolated);
+				double error = 0.0;
+				for (int k = 0; k < TimesCount; ++k)
+					error = std::max(error, ::fabs(interpolated[k] - times[j * TimesCount + k]));
+
+				if (error > target_error)
+					++missed;
+				if (flag && error > target_error)
+					cell_exact = 1;
+				else
+					worst = std::max(worst, error);
+			}
+		}
+		return worst;
+	}
+
+	// Bilinear interpolation within a cell
+	void interpolate(int i, int j, double v, double u, double times[]) const
+	{
+		const float* n00 = &nodes[((size_t) i * columns + j) * TimesCount];
+		const float* n01 = n00 + TimesCount;
+		const float* n10 = n00 + (size_t) columns * TimesCount;
+		const float* n11 = n10 + TimesCount;
+		for (int k = 0; k < TimesCount; ++k)
+			times[k] = (1 - v) * ((1 - u) * n00[k] + u * n01[k]) + v * ((1 - u) * n10[k] + u * n11[k]);
+	}
+
+	PrayerTimes engine;
+	SolarEphemeris ephemeris;
+	int year, month, day;
+	double elevation;
+	double min_latitude, max_latitude;
+	double min_longitude, max_longitude;
+	double step;
+	int rows, columns;
+	std::vector<float> nodes;		// Times of each node, in UTC seconds
+	std::vector<char> exact;		// Whether each cell is computed exactly
+	double max_error;
+};
+
+}
+
+#endif /* PRAYERTIMES_GRID_HPP */
@@ -29,10 +29,23 @@ http://www.gnu.org/copyleft/gpl.html
 #include <ctime>
 #include <cmath>
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <unistd.h>
 #include <getopt.h>
 
 #include "prayertimes.hpp"
+#include "tzfile.hpp"
+#include "tzmap.hpp"
+#include "citydb.hpp"
+#include "dem.hpp"
 
 #define PROG_NAME "prayertimes"
 #define PROG_NAME_FRIENDLY "PrayerTimes"
@@ -40,6 +53,12 @@ http://www.gnu.org/copyleft/gpl.html
 
 using prayertimes::PrayerTimes;
 
+#define BULK_CHUNK_ROWS 1024		// Rows handed to a bulk worker at once
+#define MAX_FIELDS 32
+#define STREAM_BUFFER_SIZE 65536		// Size of the stream mode input and output buffers
+#define STREAM_MAX_LINE 1024
+#define NEAR_CITY_RADIUS 50000.0		// Meters within which a city lends its elevation
+
 static const char* const TimeName[] =
 {
 	"Imsak",
@@ -75,12 +94,18 @@ void print_help(FILE* f)
 	      "    --version                   -v  prints name and version, then exits\n"
 	      "    --date arg                  -d  get prayer times for arbitrary date\n"
 	      "    --timezone arg              -z  get prayer times for arbitrary timezone\n"
+	      "    --tz arg                    -Z  use a named timezone such as Europe/Paris\n"
+	      "    --tz-map arg                -M  find timezones of locations from a boundaries file\n"
+	      "    --cities arg                -C  find elevations and timezones from a city database\n"
+	      "    --near arg                  -N  latitude,longitude of a location near a known city\n"
+	      "    --dem arg                   -E  find elevations from a directory of SRTM .hgt tiles\n"
 	      "  * --latitude arg              -l  latitude of desired location\n"
 	      "  * --longitude arg             -n  longitude of desired location\n"
 	      "    --elevation arg             -e  elevation of desired location\n"
 	      "    --calc-method arg           -c  select prayer time calculation method\n"
 	      "    --asr-juristics-method arg  -a  select Juristic method for calculating Asr prayer time\n"
 	      "    --high-lats-method arg      -i  select adjusting method for higher latitude\n"
+	      "    --precision arg             -p  select precision of the sun position\n"
 	      " ** --imsak-minutes arg             minutes before Fajr for calculating Imsak time\n"
 	      "    --dhuhr-minutes arg             minutes after mid-way for calculating Dhuhr prayer time\n"
 	      " ** --maghrib-minutes arg           minutes after sunset for calculating Maghrib prayer time\n"
@@ -89,10 +114,43 @@ void print_help(FILE* f)
 	      " ** --fajr-angle arg                angle for calculating Fajr prayer time\n"
 	      " ** --maghrib-angle arg             angle for calculating Maghrib prayer time\n"
 	      " ** --isha-angle arg                angle for calculating Isha prayer time\n"
+	      "    --bulk arg                  -b  compute prayer times for every location of a file\n"
+	      "    --output arg                -o  write bulk results to a file instead of stdout\n"
+	      "    --threads arg               -j  number of bulk worker threads, all cores by default\n"
+	      "    --stream                    -s  answer requests read line by line from stdin\n"
+	      "    --flush-every arg           -f  flush stream results at least every arg lines\n"
 	      "\n"
-	      "  * These options are required\n"
+	      "  * These options are required, except in bulk mode\n"
 	      " ** By providing any of these options the calculation method is set to custom\n"
 	      "\n"
+	      " Bulk file format\n"
+	      "    One location per line, with fields separated by commas or tabs:\n"
+	      "      latitude, longitude [, elevation [, timezone [, method [, offsets...]]]]\n"
+	      "    Empty or missing fields take the value given on the command line. Offsets\n"
+	      "    are minutes added to Imsak, Fajr, ... Midnight in that order. Empty lines,\n"
+	      "    lines starting with '#' and a leading header line are ignored.\n"
+	      "\n"
+	      " Stream request format\n"
+	      "    One request per line, with fields separated by spaces, commas or tabs:\n"
+	      "      latitude longitude [elevation [date [timezone [method]]]]\n"
+	      "    date is YYYY-MM-DD. Missing fields or '-' take the value given on the\n"
+	      "    command line. Each request is answered by a line of times separated by\n"
+	      "    commas, or by a line starting with 'error'. Results are flushed whenever\n"
+	      "    no more input is available, or after --flush-every lines (default 1024).\n"
+	      "\n"
+	      " Timezones\n"
+	      "    Times are given in the timezone of --timezone, else of --tz. Otherwise,\n"
+	      "    with --tz-map, the timezone of each location is found from a GeoJSON file\n"
+	      "    of timezone boundaries, such as those of timezone-boundary-builder, with\n"
+	      "    no network access. Otherwise, with --cities, the timezone of the nearest\n"
+	      "    city is used. Without any of them, the local timezone is used.\n"
+	      "\n"
+	      " Elevations\n"
+	      "    Locations given without an elevation take the one of --dem if its tiles\n"
+	      "    cover them, else with --cities, a database built by the citydb tool,\n"
+	      "    the one of the nearest city within 50 km, else 0. --near names the\n"
+	      "    nearest city, and lends its elevation whatever its distance.\n"
+	      "\n"
 	      " Possible arguments for --calc-method\n"
 	      "    mwl         Muslim World League\n"
 	      "    isna        Islamic Society of North America\n"
@@ -112,17 +170,546 @@ void print_help(FILE* f)
 	      "    midnight      Middle of night\n"
 	      "    oneseventh    1/7th of night\n"
 	      "    anglebased    Angle/60th of night\n"
+	      "\n"
+	      " Possible arguments for --precision\n"
+	      "    fast          Approximate sun position (default)\n"
+	      "    high          Precise sun position and dip of the horizon, slower\n"
+	      "    hybrid        Precise for times close to a minute boundary only\n"
 	      , stderr);
 }              
 
+struct BulkRow
+{
+	prayertimes::Location location;
+	int method;		// Index of CalculationMethodName, or -1 for the command line one
+	double offsets[prayertimes::TimesCount];		// In minutes
+};
+
+// Find a calculation method by name, or return -1
+static int find_calc_method(const char* name)
+{
+	for (int i = 0; i < prayertimes::CalculationMethodsCount; ++i)
+		if (strcasecmp(name, CalculationMethodName[i]) == 0)
+			return i;
+	return -1;
+}
+
+// Parse a whole field as a number, leaving value untouched if the field is empty
+static bool parse_field(const char* field, double& value)
+{
+	if (*field == '\0')
+		return true;
+	char* end;
+	double number = strtod(field, &end);
+	if (end == field || *end != '\0')
+		return false;
+	value = number;
+	return true;
+}
+
+// Split a line in place into fields separated by commas or tabs
+// Returns the number of fields
+static int split_fields(char* line, char* fields[], int max_fields)
+{
+	int count = 0;
+	for (char* p = line; count < max_fields; ++p)
+	{
+		p += strspn(p, " ");
+		fields[count++] = p;
+		p += strcspn(p, ",\t");
+		char* end = p;
+		while (end > fields[count - 1] && end[-1] == ' ')
+			--end;
+		bool last = *p == '\0';
+		*end = '\0';
+		if (last)
+			break;
+	}
+	return count;
+}
+
+// Parse a line of a bulk file into row
+// Returns 1 on success, 0 if the line carries no location and -1 on error
+static int parse_bulk_row(char* line, const prayertimes::Location& defaults, BulkRow& row)
+{
+	line[strcspn(line, "\r\n")] = '\0';
+	if (line[strspn(line, " \t,")] == '\0' || line[0] == '#')
+		return 0;
+
+	char* fields[MAX_FIELDS];
+	int count = split_fields(line, fields, MAX_FIELDS);
+
+	row.location = defaults;
+	row.method = -1;
+	for (int i = 0; i < prayertimes::TimesCount; ++i)
+		row.offsets[i] = 0.0;
+
+	if (count < 2 || *fields[0] == '\0' || *fields[1] == '\0')
+		return -1;
+	if (!parse_field(fields[0], row.location.latitude) ||
+			!parse_field(fields[1], row.location.longitude) ||
+			(count > 2 && !parse_field(fields[2], row.location.elevation)) ||
+			(count > 3 && !parse_field(fields[3], row.location.timezone)))
+		return -1;
+	if (count > 4 && *fields[4] != '\0' && (row.method = find_calc_method(fields[4])) < 0)
+		return -1;
+	for (int i = 5; i < count && i - 5 < prayertimes::TimesCount; ++i)
+		if (!parse_field(fields[i], row.offsets[i - 5]))
+			return -1;
+	return 1;
+}
+
+// Write a time given in seconds as HH:MM:SS, followed by +1 or -1 if it
+// falls on the next or previous day
+static int format_time(char* buffer, size_t size, double time)
+{
+	if (std::isnan(time))
+		return snprintf(buffer, size, "--:--:--");
+	int seconds = time;
+	int day = seconds < 0 ? -1 : seconds / 86400;
+	seconds -= day * 86400;
+	const char* suffix = day > 0 ? "+1" : day < 0 ? "-1" : "";
+	return snprintf(buffer, size, "%.2d:%.2d:%.2d%s", seconds / 3600, seconds / 60 % 60, seconds % 60, suffix);
+}
+
+// Elevations of locations given without one, from elevation tiles, else
+// from the nearest city close enough
+class LocationElevations : public prayertimes::ElevationResolver
+{
+public:
+	LocationElevations(const prayertimes::ElevationMap& dem, const prayertimes::CityDatabase* cities) :
+		dem(dem), cities(cities)
+	{
+	}
+
+	double get_elevation(double latitude, double longitude) const
+	{
+		double elevation = dem.get_elevation(latitude, longitude);
+		long c = std::isnan(elevation) && cities ? cities->find_nearest(latitude, longitude, NEAR_CITY_RADIUS) : -1;
+		return c < 0 ? elevation : cities->city(c).elevation;
+	}
+
+private:
+	const prayertimes::ElevationMap& dem;
+	const prayertimes::CityDatabase* cities;
+};
+
+// Compute and format chunks of rows until none is left
+static void bulk_worker(const PrayerTimes& default_engine, const std::vector<PrayerTimes>& engines,
+		int year, int month, int day, const std::vector<BulkRow>& rows,
+		std::vector<std::string>& chunks, std::atomic<size_t>& next_chunk)
+{
+	std::vector<size_t> indices;
+	std::vector<double> latitudes, longitudes, elevations, timezones, method_times;
+	std::vector<double> chunk_times(BULK_CHUNK_ROWS * prayertimes::TimesCount);
+	for (;;)
+	{
+		size_t chunk = next_chunk++;
+		if (chunk >= chunks.size())
+			return;
+
+		std::string& output = chunks[chunk];
+		size_t first = chunk * BULK_CHUNK_ROWS;
+		size_t end = std::min(rows.size(), first + BULK_CHUNK_ROWS);
+
+		// Rows of each calculation method are computed together by the batch
+		// engine, -1 being the command line one
+		for (int method = -1; method < prayertimes::CalculationMethodsCount; ++method)
+		{
+			indices.clear();
+			latitudes.clear();
+			longitudes.clear();
+			elevations.clear();
+			timezones.clear();
+			for (size_t r = first; r < end; ++r)
+				if (rows[r].method == method)
+				{
+					const prayertimes::Location& location = rows[r].location;
+					indices.push_back(r - first);
+					latitudes.push_back(location.latitude);
+					longitudes.push_back(location.longitude);
+					elevations.push_back(location.elevation);
+					timezones.push_back(location.timezone);
+				}
+			if (indices.empty())
+				continue;
+
+			const PrayerTimes& engine = method < 0 ? default_engine : engines[method];
+			method_times.resize(indices.size() * prayertimes::TimesCount);
+			engine.get_prayer_times(year, month, day, indices.size(), &latitudes[0], &longitudes[0],
+					&elevations[0], &timezones[0], &method_times[0]);
+			for (size_t i = 0; i < indices.size(); ++i)
+				std::copy(&method_times[i * prayertimes::TimesCount], &method_times[(i + 1) * prayertimes::TimesCount],
+						&chunk_times[indices[i] * prayertimes::TimesCount]);
+		}
+
+		for (size_t r = first; r < end; ++r)
+		{
+			const BulkRow& row = rows[r];
+			const double* times = &chunk_times[(r - first) * prayertimes::TimesCount];
+
+			char line[256];
+			int length = snprintf(line, sizeof(line), "%.5f,%.5f", row.location.latitude, row.location.longitude);
+			for (int i = 0; i < prayertimes::TimesCount; ++i)
+			{
+				line[length++] = ',';
+				length += format_time(line + length, sizeof(line) - length, times[i] + row.offsets[i] * 60.0);
+			}
+			line[length++] = '\n';
+			output.append(line, length);
+		}
+	}
+}
+
+// Compute prayer times for every location of a bulk file
+static int run_bulk(const PrayerTimes& prayer_times, const char* input_path, const char* output_path,
+		int threads, time_t date, const prayertimes::Location& defaults, const prayertimes::ElevationMap& dem)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	FILE* input = strcmp(input_path, "-") == 0 ? stdin : fopen(input_path, "r");
+	if (!input)
+	{
+		fprintf(stderr, "Error: Failed to open '%s': %s\n", input_path, strerror(errno));
+		return 2;
+	}
+
+	std::vector<BulkRow> rows;
+	size_t invalid_rows = 0;
+	char* line = NULL;
+	size_t line_size = 0;
+	for (long line_number = 1; getline(&line, &line_size, input) != -1; ++line_number)
+	{
+		bool first = rows.empty() && invalid_rows == 0;
+		bool header = first && !isdigit((unsigned char) line[strspn(line, " +-.")]);
+		BulkRow row;
+		switch (parse_bulk_row(line, defaults, row))
+		{
+			case 1:
+				rows.push_back(row);
+				break;
+			case -1:
+				if (header)
+					break;
+				fprintf(stderr, "Error: %s:%ld: Invalid location, skipped\n", input_path, line_number);
+				++invalid_rows;
+				break;
+		}
+	}
+	free(line);
+	if (input != stdin)
+		fclose(input);
+
+	// Look up missing elevations tile by tile, before workers would look
+	// them up in the order of the rows
+	if (dem.is_open())
+	{
+		std::vector<size_t> missing;
+		std::vector<double> latitudes, longitudes;
+		for (size_t r = 0; r < rows.size(); ++r)
+			if (std::isnan(rows[r].location.elevation))
+			{
+				missing.push_back(r);
+				latitudes.push_back(rows[r].location.latitude);
+				longitudes.push_back(rows[r].location.longitude);
+			}
+		std::vector<double> elevations(missing.size());
+		if (!missing.empty())
+			dem.get_elevations(missing.size(), &latitudes[0], &longitudes[0], &elevations[0]);
+		for (size_t i = 0; i < missing.size(); ++i)
+			rows[missing[i]].location.elevation = elevations[i];
+	}
+
+	tm local_date;
+	localtime_r(&date, &local_date);
+	int year = 1900 + local_date.tm_year;
+	int month = local_date.tm_mon + 1;
+	int day = local_date.tm_mday;
+
+	// All engines share the sun positions of the day
+	prayertimes::SolarEphemeris ephemeris(PrayerTimes::julian(year, month, day));
+	PrayerTimes default_engine = prayer_times;
+	default_engine.set_ephemeris(&ephemeris);
+	default_engine.set_fast_trig(true);
+	std::vector<PrayerTimes> engines(prayertimes::CalculationMethodsCount, default_engine);
+	for (int i = 0; i < prayertimes::CalculationMethodsCount; ++i)
+		engines[i].set_calc_method(static_cast<prayertimes::CalculationMethod>(i));
+
+	std::vector<std::string> chunks((rows.size() + BULK_CHUNK_ROWS - 1) / BULK_CHUNK_ROWS);
+	std::atomic<size_t> next_chunk(0);
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min<size_t>(threads, std::max<size_t>(1, chunks.size()));
+
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; ++i)
+		workers.push_back(std::thread(bulk_worker, std::cref(default_engine), std::cref(engines),
+					year, month, day, std::cref(rows), std::ref(chunks), std::ref(next_chunk)));
+	bulk_worker(default_engine, engines, year, month, day, rows, chunks, next_chunk);
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+
+	FILE* output = output_path ? fopen(output_path, "w") : stdout;
+	if (!output)
+	{
+		fprintf(stderr, "Error: Failed to create '%s': %s\n", output_path, strerror(errno));
+		return 2;
+	}
+	fputs("latitude,longitude", output);
+	for (int i = 0; i < prayertimes::TimesCount; ++i)
+		fprintf(output, ",%s", TimeName[i]);
+	putc('\n', output);
+	for (size_t i = 0; i < chunks.size(); ++i)
+		fwrite(chunks[i].data(), 1, chunks[i].size(), output);
+	if ((output != stdout ? fclose(output) : fflush(output)) != 0)
+	{
+		fprintf(stderr, "Error: Failed to write results: %s\n", strerror(errno));
+		return 2;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "%zu rows in %.3lf s (%.0lf rows/s) using %d threads\n",
+			rows.size(), seconds, rows.size() / seconds, threads);
+	return invalid_rows ? 1 : 0;
+}
+
+// Output of the stream mode, written in large blocks
+struct StreamOutput
+{
+	char data[STREAM_BUFFER_SIZE];
+	size_t size;
+	size_t pending_lines;
+
+	StreamOutput() : size(0), pending_lines(0)
+	{
+	}
+
+	bool flush()
+	{
+		for (size_t written = 0; written < size; )
+		{
+			ssize_t n = write(STDOUT_FILENO, data + written, size - written);
+			if (n < 0 && errno != EINTR)
+				return false;
+			if (n > 0)
+				written += n;
+		}
+		size = 0;
+		pending_lines = 0;
+		return true;
+	}
+
+	bool write_line(const char* line, size_t length)
+	{
+		if (size + length > sizeof(data) && !flush())
+			return false;
+		memcpy(data + size, line, length);
+		size += length;
+		++pending_lines;
+		return true;
+	}
+};
+
+// Get the timezone of a date from the named timezone if any, else from the
+// timezone of the location if a resolver is given, else from the local one
+static double date_timezone(const prayertimes::TimeZone* zone, const prayertimes::TimeZoneResolver* resolver,
+		double latitude, double longitude, int year, int month, int day)
+{
+	if (zone)
+		return zone->get_timezone(year, month, day);
+	if (resolver)
+		return resolver->get_timezone(latitude, longitude, year, month, day);
+	return PrayerTimes::get_timezone(year, month, day);
+}
+
+static double date_timezone(const prayertimes::TimeZone* zone, const prayertimes::TimeZoneResolver* resolver,
+		double latitude, double longitude, time_t date)
+{
+	if (!zone && !resolver)
+		return PrayerTimes::get_timezone(date);
+	tm local_date;
+	localtime_r(&date, &local_date);
+	return date_timezone(zone, resolver, latitude, longitude,
+			1900 + local_date.tm_year, local_date.tm_mon + 1, local_date.tm_mday);
+}
+
+// Parse a stream request line, already split into fields
+// Returns NULL on success, or the reason of failure
+static const char* parse_stream_request(char* fields[], int count, const prayertimes::Location& defaults,
+		const prayertimes::TimeZone* zone, const prayertimes::TimeZoneResolver* resolver,
+		const tm& default_date, prayertimes::Location& location,
+		int& year, int& month, int& day, int& method)
+{
+	location = defaults;
+	year = 1900 + default_date.tm_year;
+	month = default_date.tm_mon + 1;
+	day = default_date.tm_mday;
+	method = -1;
+
+	for (int i = 0; i < count; ++i)
+		if (strcmp(fields[i], "-") == 0)
+			*fields[i] = '\0';
+
+	if (count < 2 || *fields[0] == '\0' || *fields[1] == '\0' ||
+			!parse_field(fields[0], location.latitude) || !parse_field(fields[1], location.longitude))
+		return "latitude and longitude are required";
+	if (count > 2 && !parse_field(fields[2], location.elevation))
+		return "invalid elevation";
+	if (count > 3 && *fields[3] != '\0')
+	{
+		int length = 0;
+		if (sscanf(fields[3], "%d-%d-%d%n", &year, &month, &day, &length) != 3 || fields[3][length] != '\0' ||
+				month < 1 || month > 12 || day < 1 || day > 31)
+			return "invalid date";
+	}
+	if (count > 4 && !parse_field(fields[4], location.timezone))
+		return "invalid timezone";
+	if (count > 5 && *fields[5] != '\0' && (method = find_calc_method(fields[5])) < 0)
+		return "unknown calculation method";
+	if (count > 6)
+		return "too many fields";
+	if (std::isnan(location.timezone))
+		location.timezone = date_timezone(zone, resolver, location.latitude, location.longitude, year, month, day);
+	return NULL;
+}
+
+// Answer requests read line by line from stdin until its end
+// Input is read in large blocks, and pending results are flushed before
+// waiting for more, so interactive clients get their answers right away.
+static int run_stream(const PrayerTimes& prayer_times, size_t flush_every, time_t date,
+		const prayertimes::Location& defaults, const prayertimes::TimeZone* zone)
+{
+	tm default_date;
+	localtime_r(&date, &default_date);
+
+	// Engines share the sun positions of the last requested date
+	prayertimes::SolarEphemeris ephemeris;
+	double ephemeris_date = NAN;
+	PrayerTimes default_engine = prayer_times;
+	default_engine.set_ephemeris(&ephemeris);
+	std::vector<PrayerTimes> engines(prayertimes::CalculationMethodsCount, default_engine);
+	for (int i = 0; i < prayertimes::CalculationMethodsCount; ++i)
+		engines[i].set_calc_method(static_cast<prayertimes::CalculationMethod>(i));
+
+	static char input[STREAM_BUFFER_SIZE];
+	static StreamOutput output;
+	size_t start = 0, end = 0;
+	bool at_end = false;
+	bool overlong = false;
+
+	for (;;)
+	{
+		char* line = static_cast<char*>(memchr(input + start, '\n', end - start));
+		if (!line && !at_end)
+		{
+			// Compact the buffer and wait for more input
+			memmove(input, input + start, end - start);
+			end -= start;
+			start = 0;
+			if (end == sizeof(input))
+			{
+				overlong = true;		// Drop the line, reporting it once complete
+				end = 0;
+			}
+			if (!output.flush())
+				return 2;
+			ssize_t n = read(STDIN_FILENO, input + end, sizeof(input) - end);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+			{
+				fprintf(stderr, "Error: Failed to read requests: %s\n", strerror(errno));
+				return 2;
+			}
+			if (n == 0)
+				at_end = true;
+			end += n;
+			continue;
+		}
+		if (!line)
+		{
+			if (start == end && !overlong)
+				break;
+			line = input + end;		// Last line lacks a newline
+		}
+
+		*line = '\0';
+		char* request = input + start;
+		start = line - input + (line < input + end ? 1 : 0);
+		if (line == input + end)
+			end = start;
+
+		char result[256];
+		size_t length;
+		size_t line_length = line - request;		// Before strtok cuts it
+		char* fields[MAX_FIELDS];
+		int count = 0;
+		for (char* token = strtok(request, " \t,\r"); token && count < MAX_FIELDS; token = strtok(NULL, " \t,\r"))
+			fields[count++] = token;
+
+		prayertimes::Location location;
+		int year, month, day, method;
+		const char* error = NULL;
+		if (overlong || line_length > STREAM_MAX_LINE)
+			error = "line too long";
+		else if (count == 0)
+			continue;
+		else
+			error = parse_stream_request(fields, count, defaults, zone, prayer_times.get_timezone_resolver(),
+					default_date, location, year, month, day, method);
+		overlong = false;
+
+		if (error)
+			length = snprintf(result, sizeof(result), "error: %s\n", error);
+		else
+		{
+			double jd = PrayerTimes::julian(year, month, day);
+			if (jd != ephemeris_date)
+			{
+				ephemeris = prayertimes::SolarEphemeris(jd);
+				ephemeris_date = jd;
+			}
+
+			const PrayerTimes& engine = method < 0 ? default_engine : engines[method];
+			double times[prayertimes::TimesCount];
+			engine.get_prayer_times(year, month, day, location, times);
+
+			length = 0;
+			for (int i = 0; i < prayertimes::TimesCount; ++i)
+			{
+				if (i > 0)
+					result[length++] = ',';
+				length += format_time(result + length, sizeof(result) - length, times[i]);
+			}
+			result[length++] = '\n';
+		}
+
+		if (!output.write_line(result, length) ||
+				(output.pending_lines >= flush_every && !output.flush()))
+			return 2;
+	}
+
+	return output.flush() ? 0 : 2;
+}
+
 int main(int argc, char* argv[])
 {
 	PrayerTimes prayer_times;
 	double latitude = NAN;
 	double longitude = NAN;
-	double elevation = 0;
+	double elevation = NAN;
 	time_t date = time(NULL);
 	double timezone = NAN;
+	const prayertimes::TimeZone* zone = NULL;
+	prayertimes::TimeZoneMap tz_map;
+	prayertimes::CityDatabase city_database;
+	prayertimes::ElevationMap dem;
+	bool near = false;
+	const char* bulk_path = NULL;
+	const char* output_path = NULL;
+	int threads = 0;
+	bool stream = false;
+	int flush_every = 1024;
 
 	// Parse options
 	for (;;)
@@ -135,7 +722,7 @@ int main(int argc, char* argv[])
 			{ "timezone",             required_argument, NULL, 'z' },
 			{ "latitude",             required_argument, NULL, 'l' },
 			{ "longitude",            required_argument, NULL, 'n' },
-			{ "elevation",            required_argument, NULL, 'n' },
+			{ "elevation",            required_argument, NULL, 'e' },
 			{ "calc-method",          required_argument, NULL, 'c' },
 			{ "asr-juristics-method", required_argument, NULL, 'a' },
 			{ "high-lats-method",     required_argument, NULL, 'i' },
@@ -147,6 +734,17 @@ int main(int argc, char* argv[])
 			{ "fajr-angle",           required_argument, NULL, 0   },
 			{ "maghrib-angle",        required_argument, NULL, 0   },
 			{ "isha-angle",           required_argument, NULL, 0   },
+			{ "bulk",                 required_argument, NULL, 'b' },
+			{ "output",               required_argument, NULL, 'o' },
+			{ "threads",              required_argument, NULL, 'j' },
+			{ "stream",               no_argument,       NULL, 's' },
+			{ "flush-every",          required_argument, NULL, 'f' },
+			{ "precision",            required_argument, NULL, 'p' },
+			{ "tz",                   required_argument, NULL, 'Z' },
+			{ "tz-map",               required_argument, NULL, 'M' },
+			{ "cities",               required_argument, NULL, 'C' },
+			{ "near",                 required_argument, NULL, 'N' },
+			{ "dem",                  required_argument, NULL, 'E' },
 			{ 0, 0, 0, 0 }
 		};
 
@@ -163,12 +761,12 @@ int main(int argc, char* argv[])
 		};
 
 		int option_index = 0;
-		int c = getopt_long(argc, argv, "hvd:z:l:n:e:c:a:i:", long_options, &option_index);
+		int c = getopt_long(argc, argv, "hvd:z:Z:M:C:N:E:l:n:e:c:a:i:p:b:o:j:sf:", long_options, &option_index);
 
 		if (c == -1)
 			break;		// Last option
 
-		if (!optarg && c != 'h' && c != 'v')
+		if (!optarg && c != 'h' && c != 'v' && c != 's')
 		{
 			fprintf(stderr, "Error: %s option requires an argument\n", long_options[option_index].name);
 			return 2;
@@ -238,6 +836,46 @@ int main(int argc, char* argv[])
 					return 2;
 				}
 				break;
+			case 'Z':		// --tz
+				zone = prayertimes::TimeZoneCache::shared().get(optarg);
+				if (!zone)
+				{
+					fprintf(stderr, "Error: Unknown timezone '%s'\n", optarg);
+					return 2;
+				}
+				break;
+			case 'M':		// --tz-map
+				if (!tz_map.load(optarg))
+				{
+					fprintf(stderr, "Error: Cannot load timezone map '%s'\n", optarg);
+					return 2;
+				}
+				break;
+			case 'C':		// --cities
+				if (!city_database.open(optarg))
+				{
+					fprintf(stderr, "Error: Cannot open city database '%s'\n", optarg);
+					return 2;
+				}
+				break;
+			case 'N':		// --near
+			{
+				int length = 0;
+				if (sscanf(optarg, "%lf,%lf%n", &latitude, &longitude, &length) != 2 || optarg[length] != '\0')
+				{
+					fprintf(stderr, "Error: Invalid location '%s'\n", optarg);
+					return 2;
+				}
+				near = true;
+				break;
+			}
+			case 'E':		// --dem
+				if (!dem.open(optarg))
+				{
+					fprintf(stderr, "Error: Cannot open elevation tiles directory '%s'\n", optarg);
+					return 2;
+				}
+				break;
 			case 'l':		// --latitude
 				if (sscanf(optarg, "%lf", &latitude) != 1)
 				{
@@ -260,19 +898,16 @@ int main(int argc, char* argv[])
 				}
 				break;
 			case 'c':		// --calc-method
-				int i;
-				for (i = 0; i < prayertimes::CalculationMethodsCount; ++i)
-					if (strcasecmp(optarg, CalculationMethodName[i]) == 0)
-					{
-						prayer_times.set_calc_method(static_cast<prayertimes::CalculationMethod>(i));
-						break;
-					}
-				if (i == prayertimes::CalculationMethodsCount)		// If none of method names has matched
+			{
+				int i = find_calc_method(optarg);
+				if (i < 0)		// If none of method names has matched
 				{
 					fprintf(stderr, "Error: Unknown calculation method '%s'\n", optarg);
 					return 2;
 				}
+				prayer_times.set_calc_method(static_cast<prayertimes::CalculationMethod>(i));
 				break;
+			}
 			case 'a':		// --asr-juristics-method
 				if (strcmp(optarg, "standard") == 0)
 					prayer_times.settings.asr_juristics_method = prayertimes::StandardAsr;
@@ -299,6 +934,42 @@ int main(int argc, char* argv[])
 					return 2;
 				}
 				break;
+			case 'p':		// --precision
+				if (strcmp(optarg, "fast") == 0)
+					prayer_times.set_precision(prayertimes::FastPrecision);
+				else if (strcmp(optarg, "high") == 0)
+					prayer_times.set_precision(prayertimes::HighPrecision);
+				else if (strcmp(optarg, "hybrid") == 0)
+					prayer_times.set_precision(prayertimes::HybridPrecision);
+				else
+				{
+					fprintf(stderr, "Error: Unknown precision '%s'\n", optarg);
+					return 2;
+				}
+				break;
+			case 'b':		// --bulk
+				bulk_path = optarg;
+				break;
+			case 'o':		// --output
+				output_path = optarg;
+				break;
+			case 'j':		// --threads
+				if (sscanf(optarg, "%d", &threads) != 1 || threads < 0)
+				{
+					fprintf(stderr, "Error: Invalid number of threads '%s'\n", optarg);
+					return 2;
+				}
+				break;
+			case 's':		// --stream
+				stream = true;
+				break;
+			case 'f':		// --flush-every
+				if (sscanf(optarg, "%d", &flush_every) != 1 || flush_every < 1)
+				{
+					fprintf(stderr, "Error: Invalid number of lines '%s'\n", optarg);
+					return 2;
+				}
+				break;
 			default:
 				fprintf(stderr, "Error: Unknown option '%c'\n", c);
 				print_help(stderr);
@@ -306,7 +977,43 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	if (isnan(latitude) || isnan(longitude))
+	// Named timezones take precedence over the timezone map, and the map
+	// over the cities
+	const prayertimes::CityDatabase* cities = city_database.is_open() ? &city_database : NULL;
+	prayertimes::CityTimeZones city_timezones(city_database);
+	if (tz_map.is_loaded() && !zone)
+		prayer_times.set_timezone_resolver(&tz_map);
+	else if (cities && !zone)
+		prayer_times.set_timezone_resolver(&city_timezones);
+
+	// Elevations of the tiles take precedence over the ones of cities
+	LocationElevations elevations(dem, cities);
+	if (dem.is_open() || cities)
+		prayer_times.set_elevation_resolver(&elevations);
+
+	if (near && !cities)
+	{
+		fprintf(stderr, "Error: --near requires a city database\n");
+		return 2;
+	}
+
+	if (bulk_path)
+	{
+		// With a timezone map, rows without a timezone get the one of their
+		// location from the engine
+		if (std::isnan(timezone) && !prayer_times.get_timezone_resolver())
+			timezone = date_timezone(zone, NULL, latitude, longitude, date);
+		prayertimes::Location defaults = { latitude, longitude, elevation, timezone };
+		return run_bulk(prayer_times, bulk_path, output_path, threads, date, defaults, dem);
+	}
+
+	if (stream)
+	{
+		prayertimes::Location defaults = { latitude, longitude, elevation, timezone };
+		return run_stream(prayer_times, flush_every, date, defaults, zone);
+	}
+
+	if (std::isnan(latitude) || std::isnan(longitude))
 	{
 		fprintf(stderr, "Error: You must provide both latitude and longitude\n");
 		return 2;
@@ -314,8 +1021,25 @@ int main(int argc, char* argv[])
 
 	fputs(PROG_NAME_FRIENDLY " " PROG_VERSION "\n\n", stderr);
 
-	if (isnan(timezone))
-		timezone = PrayerTimes::get_timezone(date);
+	if (std::isnan(elevation))
+		elevation = elevations.get_elevation(latitude, longitude);
+	if (near)
+	{
+		double distance;
+		long c = cities->find_nearest(latitude, longitude, HUGE_VAL, &distance);
+		if (c >= 0)
+		{
+			const prayertimes::CityRecord& city = cities->city(c);
+			fprintf(stderr, "city          : %s, %.2s (%.1lf km)\n", cities->name(city), city.country,
+					distance / 1000.0);
+			if (std::isnan(elevation))
+				elevation = city.elevation;
+		}
+	}
+	if (std::isnan(elevation))
+		elevation = 0.0;
+	if (std::isnan(timezone))
+		timezone = date_timezone(zone, prayer_times.get_timezone_resolver(), latitude, longitude, date);
 
 	double times[prayertimes::TimesCount];
 	fprintf(stderr, "date          : %s", ctime(&date));
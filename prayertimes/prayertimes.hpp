@@ -37,10 +37,17 @@ http://code.ebrahim.ir/prayertimes/
 
 \*--------------------------------------------------------------------------*/
 
+#ifndef PRAYERTIMES_HPP
+#define PRAYERTIMES_HPP
+
+#include <cstddef>
 #include <utility>
+#include <vector>
 #include <cmath>
 #include <ctime>
 
+#include "dmath_simd.hpp"
+
 namespace prayertimes
 {
 
@@ -90,6 +97,14 @@ enum HighLatitudeMethod
 	None,          // No adjustment
 };
 
+// Precision of the sun position and horizon dip
+enum Precision
+{
+	FastPrecision,     // Low precision sun position, approximate dip
+	HighPrecision,     // Meeus sun position with nutation, true dip
+	HybridPrecision,   // Fast, refining times close to a minute boundary
+};
+
 // Calculation methods
 enum CalculationMethod
 {
@@ -133,6 +148,69 @@ struct Settings : public MethodConfig
 	}
 };
 
+// Parameters of the predefined calculation methods
+constexpr MethodConfig method_config(CalculationMethod calc_method)
+{
+	return
+		calc_method == MWL     ? MethodConfig { true, 10.0, false, 18.0, true, 0.0, true,  0.0, false, 17.0, StandardMidnight } :
+		calc_method == ISNA    ? MethodConfig { true, 10.0, false, 15.0, true, 0.0, true,  0.0, false, 15.0, StandardMidnight } :
+		calc_method == Egypt   ? MethodConfig { true, 10.0, false, 19.5, true, 0.0, true,  0.0, false, 17.5, StandardMidnight } :
+		calc_method == Makkah  ? MethodConfig { true, 10.0, false, 19.0, true, 0.0, true,  0.0, true,  90.0, StandardMidnight } :
+		calc_method == Karachi ? MethodConfig { true, 10.0, false, 18.0, true, 0.0, true,  0.0, false, 18.0, StandardMidnight } :
+		calc_method == Tehran  ? MethodConfig { true, 10.0, false, 17.7, true, 0.0, false, 4.5, false, 14.0, JafariMidnight   } :
+		calc_method == Jafari  ? MethodConfig { true, 10.0, false, 16.0, true, 0.0, false, 4.0, false, 14.0, JafariMidnight   } :
+		                         MethodConfig { true, 10.0, false, 15.0, true, 0.0, true,  0.0, false, 15.0, StandardMidnight };
+}
+
+// The calculation functions read their configuration through one of the
+// two classes below. RuntimeSettings reads it from Settings, while
+// StaticSettings holds a predefined method known at compile time, so that
+// its branches and constants fold away.
+
+class RuntimeSettings
+{
+public:
+	explicit RuntimeSettings(const Settings& settings) : settings(settings)
+	{
+	}
+
+	bool imsak_is_minutes() const { return settings.imsak_is_minutes; }
+	double imsak() const { return settings.imsak; }
+	double fajr() const { return settings.fajr; }
+	double dhuhr() const { return settings.dhuhr; }
+	bool maghrib_is_minutes() const { return settings.maghrib_is_minutes; }
+	double maghrib() const { return settings.maghrib; }
+	bool isha_is_minutes() const { return settings.isha_is_minutes; }
+	double isha() const { return settings.isha; }
+	MidnightMethod midnight_method() const { return settings.midnight_method; }
+	AsrJuristicsMethod asr_juristics_method() const { return settings.asr_juristics_method; }
+	double asr() const { return settings.asr; }
+	HighLatitudeMethod high_latitudes_method() const { return settings.high_latitudes_method; }
+
+private:
+	const Settings& settings;
+};
+
+template <CalculationMethod M, AsrJuristicsMethod A, HighLatitudeMethod H>
+class StaticSettings
+{
+	static_assert(M != Custom && A != MinutesAsr, "Only predefined methods are known at compile time");
+
+public:
+	static constexpr bool imsak_is_minutes() { return method_config(M).imsak_is_minutes; }
+	static constexpr double imsak() { return method_config(M).imsak; }
+	static constexpr double fajr() { return method_config(M).fajr; }
+	static constexpr double dhuhr() { return method_config(M).dhuhr; }
+	static constexpr bool maghrib_is_minutes() { return method_config(M).maghrib_is_minutes; }
+	static constexpr double maghrib() { return method_config(M).maghrib; }
+	static constexpr bool isha_is_minutes() { return method_config(M).isha_is_minutes; }
+	static constexpr double isha() { return method_config(M).isha; }
+	static constexpr MidnightMethod midnight_method() { return method_config(M).midnight_method; }
+	static constexpr AsrJuristicsMethod asr_juristics_method() { return A; }
+	static constexpr double asr() { return 0.0; }		// Only used by MinutesAsr
+	static constexpr HighLatitudeMethod high_latitudes_method() { return H; }
+};
+
 //---------------------- Degree-Based Math Class -----------------------
 
 class DMath
@@ -162,6 +240,430 @@ public:
 	}
 };
 
+//------------------------ Solar Ephemeris Class -------------------------
+
+// Table of sun positions sampled over a range of days. The position of the
+// sun only depends on the julian date, so a single table can be shared by
+// every location computed for these days, and by several threads, as it is
+// never modified after construction.
+//
+// Positions in between samples are found by cubic interpolation. Over years
+// 1900-2100, the error of a table compared to compute_sun_position() stays
+// below 1e-8 degrees for the declination and 1e-9 hours for the equation of
+// time, and that of a precise table compared to
+// compute_precise_sun_position() below 1e-7 degrees and 1e-8 hours, as the
+// polynomials of delta_t() join with steps of up to a tenth of a second.
+// Both are under a millisecond of prayer time except where the sun barely
+// reaches the requested angle.
+class SolarEphemeris
+{
+public:
+	// Build an empty table, covering no date
+	SolarEphemeris() : start(0.0), count(0), precise(false)
+	{
+	}
+
+	// Build a table usable for the given number of days starting at a julian
+	// date as returned by julian(), for any longitude, sampling
+	// compute_precise_sun_position() if precise is set
+	SolarEphemeris(double jd, int days = 1, bool precise = false) : precise(precise)
+	{
+		start = jd - 1.0 - 1.0 / STEPS_PER_DAY;
+		count = samples(days);
+		positions.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			double sample = start + i / (double) STEPS_PER_DAY;
+			positions[i] = precise ? compute_precise_sun_position(sample) : compute_sun_position(sample);
+			// Keep the equation of time continuous between samples
+			positions[i].first -= 24.0 * ::floor(positions[i].first / 24.0 + 0.5);
+		}
+	}
+
+	// Number of sun positions sampled by a table for a number of days.
+	// Local times on a given day span about a day on either side of UT,
+	// plus one sample on each end for interpolation.
+	static int samples(int days)
+	{
+		return (days + 2) * STEPS_PER_DAY + 3;
+	}
+
+	// Whether the table samples the precise sun position
+	bool is_precise() const
+	{
+		return precise;
+	}
+
+	// Whether the table can interpolate the sun position at jd
+	bool contains(double jd) const
+	{
+		double x = (jd - start) * STEPS_PER_DAY;
+		return x >= 1.0 && x < count - 2;
+	}
+
+	// Interpolated declination angle of sun and equation of time. The
+	// equation of time is in [-12, 12] hours, which may differ from the
+	// direct formula by a whole day.
+	std::pair<double, double> sun_position(double jd) const
+	{
+		double x = (jd - start) * STEPS_PER_DAY;
+		int i = (int) x;
+		double u = x - i;
+
+		// Lagrange weights of samples i - 1 .. i + 2
+		double w0 = -u * (u - 1) * (u - 2) / 6.0;
+		double w1 = (u + 1) * (u - 1) * (u - 2) / 2.0;
+		double w2 = -(u + 1) * u * (u - 2) / 2.0;
+		double w3 = (u + 1) * u * (u - 1) / 6.0;
+
+		const std::pair<double, double>* p = &positions[i - 1];
+		return { w0 * p[0].first + w1 * p[1].first + w2 * p[2].first + w3 * p[3].first,
+			w0 * p[0].second + w1 * p[1].second + w2 * p[2].second + w3 * p[3].second };
+	}
+
+	// Same as above for n julian dates at once, all of which the table must
+	// contain. The interpolation of all dates is done side by side, so that
+	// the compiler can vectorize it.
+	void sun_positions(const double jd[], int n, double equation[], double declination[]) const
+	{
+		const std::pair<double, double>* p = &positions[0];
+		for (int k = 0; k < n; ++k)
+		{
+			double x = (jd[k] - start) * STEPS_PER_DAY;
+			int i = (int) x;
+			double u = x - i;
+			double w0 = -u * (u - 1) * (u - 2) / 6.0;
+			double w1 = (u + 1) * (u - 1) * (u - 2) / 2.0;
+			double w2 = -(u + 1) * u * (u - 2) / 2.0;
+			double w3 = (u + 1) * u * (u - 1) / 6.0;
+			const std::pair<double, double>* q = p + i - 1;
+			equation[k] = w0 * q[0].first + w1 * q[1].first + w2 * q[2].first + w3 * q[3].first;
+			declination[k] = w0 * q[0].second + w1 * q[1].second + w2 * q[2].second + w3 * q[3].second;
+		}
+	}
+
+	// Compute declination angle of sun and equation of time
+	// Ref: http://aa.usno.navy.mil/faq/docs/SunApprox.php
+	static std::pair<double, double> compute_sun_position(double jd)
+	{
+		double D = jd - 2451545.0;
+		double g = DMath::fix_angle(357.529 + 0.98560028 * D);
+		double q = DMath::fix_angle(280.459 + 0.98564736 * D);
+		double L = DMath::fix_angle(q + 1.915* DMath::sin(g) + 0.020 * DMath::sin(2 * g));
+
+		// double R = 1.00014 - 0.01671* DMath::cos(g) - 0.00014 * DMath::cos(2 * g);
+		double e = 23.439 - 0.00000036 * D;
+
+		double sin_L = DMath::sin(L);
+		double RA = DMath::arctan2(DMath::cos(e) * sin_L, DMath::cos(L)) / 15.0;
+		double equation = q / 15.0 - DMath::fix_hour(RA);
+		double declination = DMath::arcsin(DMath::sin(e) * sin_L);
+		return { equation, declination };
+	}
+
+	// Compute declination angle of sun and equation of time from the VSOP87
+	// theory truncated as in the Solar Position Algorithm of NREL, with the
+	// main terms of nutation, aberration and the difference between
+	// dynamical and universal time. The sun position is within a few
+	// arcseconds over years 1900-2100, against about an arcminute for the
+	// approximation above, at about twenty times the cost.
+	// Ref: Reda and Andreas, Solar Position Algorithm for Solar Radiation
+	// Applications, NREL/TP-560-34302, and Jean Meeus, Astronomical
+	// Algorithms, 2nd ed., chapters 22, 25 and 28
+	static std::pair<double, double> compute_precise_sun_position(double jd)
+	{
+		double tau = (jd + delta_t(jd) / 86400.0 - 2451545.0) / 365250.0;		// Julian millennia
+		double T = tau * 10.0;		// Julian centuries
+
+		// Geocentric longitude and latitude of the sun, distance to the earth
+		double L = vsop_series(earth_longitude(), tau) * (180.0 / M_PI);
+		double B = vsop_series(earth_latitude(), tau) * (180.0 / M_PI);
+		double R = vsop_series(earth_radius(), tau);
+		double longitude = DMath::fix_angle(L + 180.0);
+		double latitude = -B;
+
+		// Nutation in longitude and obliquity, in degrees
+		double omega = DMath::fix_angle(125.04452 - 1934.136261 * T);
+		double L_sun = 280.4665 + 36000.7698 * T;
+		double L_moon = 218.3165 + 481267.8813 * T;
+		double nutation = (-17.20 * DMath::sin(omega) - 1.32 * DMath::sin(2 * L_sun) -
+				0.23 * DMath::sin(2 * L_moon) + 0.21 * DMath::sin(2 * omega)) / 3600.0;
+		double obliquity_nutation = (9.20 * DMath::cos(omega) + 0.57 * DMath::cos(2 * L_sun) +
+				0.10 * DMath::cos(2 * L_moon) - 0.09 * DMath::cos(2 * omega)) / 3600.0;
+
+		double e0 = 23.0 + (26.0 + (21.448 - T * (46.8150 + T * (0.00059 - T * 0.001813))) / 60.0) / 60.0;
+		double epsilon = e0 + obliquity_nutation;
+		double lambda = longitude + nutation - 20.4898 / (3600.0 * R);		// Apparent longitude
+
+		double sin_lambda = DMath::sin(lambda);
+		double RA = DMath::arctan2(sin_lambda * DMath::cos(epsilon) - DMath::tan(latitude) * DMath::sin(epsilon),
+				DMath::cos(lambda));
+		double declination = DMath::arcsin(DMath::sin(latitude) * DMath::cos(epsilon) +
+				DMath::cos(latitude) * DMath::sin(epsilon) * sin_lambda);
+
+		// Equation of time from the mean longitude of the sun
+		double M = 280.4664567 + tau * (360007.6982779 + tau * (0.03032028 +
+					tau * (1.0 / 49931.0 + tau * (-1.0 / 15300.0 - tau / 2000000.0))));
+		double equation = M - 0.0057183 - RA + nutation * DMath::cos(epsilon);
+		equation -= 360.0 * ::floor(equation / 360.0 + 0.5);
+		return { equation / 15.0, declination };
+	}
+
+	// Approximate difference between dynamical and universal time at a
+	// julian date, in seconds, continuous over years 1860-2150 so that
+	// precise tables interpolate it smoothly
+	// Ref: Espenak and Meeus, Five Millennium Canon of Solar Eclipses
+	static double delta_t(double jd)
+	{
+		double y = 2000.0 + (jd - 2451545.0) / 365.25;
+		double t = y - 2000.0;
+		if (y < 1860.0 || y >= 2150.0)
+		{
+			double u = (y - 1820.0) / 100.0;
+			return -20.0 + 32.0 * u * u;
+		}
+		if (y < 1900.0)
+		{
+			t = y - 1860.0;
+			return 7.62 + t * (0.5737 + t * (-0.251754 + t * (0.01680668 + t * (-0.0004473624 + t / 233174.0))));
+		}
+		if (y < 1920.0)
+		{
+			t = y - 1900.0;
+			return -2.79 + t * (1.494119 + t * (-0.0598939 + t * (0.0061966 - t * 0.000197)));
+		}
+		if (y < 1941.0)
+		{
+			t = y - 1920.0;
+			return 21.20 + t * (0.84493 + t * (-0.076100 + t * 0.0020936));
+		}
+		if (y < 1961.0)
+		{
+			t = y - 1950.0;
+			return 29.07 + 0.407 * t - t * t / 233.0 + t * t * t / 2547.0;
+		}
+		if (y < 1986.0)
+		{
+			t = y - 1975.0;
+			return 45.45 + 1.067 * t - t * t / 260.0 - t * t * t / 718.0;
+		}
+		if (y < 2005.0)
+			return 63.86 + t * (0.3345 + t * (-0.060374 + t * (0.0017275 + t * (0.000651814 + t * 0.00002373599))));
+		if (y < 2050.0)
+			return 62.92 + t * (0.32217 + t * 0.005589);
+		double u = (y - 1820.0) / 100.0;
+		return -20.0 + 32.0 * u * u - 0.5628 * (2150.0 - y);
+	}
+
+private:
+	static const int STEPS_PER_DAY = 2;		// Samples per day
+
+	// Periodic term A cos(B + C tau) of a VSOP87 series
+	struct VsopTerm
+	{
+		double a;
+		double b;
+		double c;
+	};
+
+	// Series of terms for each power of tau, in units of 1e-8
+	struct VsopSeries
+	{
+		int powers;
+		const VsopTerm* terms[6];
+		int counts[6];
+	};
+
+	// Evaluate a VSOP87 series at tau julian millennia from J2000
+	static double vsop_series(const VsopSeries& series, double tau)
+	{
+		double value = 0.0;
+		for (int i = series.powers - 1; i >= 0; --i)
+		{
+			double sum = 0.0;
+			for (int j = 0; j < series.counts[i]; ++j)
+				sum += series.terms[i][j].a * ::cos(series.terms[i][j].b + series.terms[i][j].c * tau);
+			value = value * tau + sum;
+		}
+		return value / 1e8;
+	}
+
+	// Heliocentric longitude of the earth, in radians
+	static const VsopSeries& earth_longitude()
+	{
+		static const VsopTerm L0[] = {
+			{ 175347046, 0, 0 }, { 3341656, 4.6692568, 6283.07585 }, { 34894, 4.6261, 12566.1517 },
+			{ 3497, 2.7441, 5753.3849 }, { 3418, 2.8289, 3.5231 }, { 3136, 3.6277, 77713.7715 },
+			{ 2676, 4.4181, 7860.4194 }, { 2343, 6.1352, 3930.2097 }, { 1324, 0.7425, 11506.7698 },
+			{ 1273, 2.0371, 529.691 }, { 1199, 1.1096, 1577.3435 }, { 990, 5.233, 5884.927 },
+			{ 902, 2.045, 26.298 }, { 857, 3.508, 398.149 }, { 780, 1.179, 5223.694 },
+			{ 753, 2.533, 5507.553 }, { 505, 4.583, 18849.228 }, { 492, 4.205, 775.523 },
+			{ 357, 2.92, 0.067 }, { 317, 5.849, 11790.629 }, { 284, 1.899, 796.298 },
+			{ 271, 0.315, 10977.079 }, { 243, 0.345, 5486.778 }, { 206, 4.806, 2544.314 },
+			{ 205, 1.869, 5573.143 }, { 202, 2.458, 6069.777 }, { 156, 0.833, 213.299 },
+			{ 132, 3.411, 2942.463 }, { 126, 1.083, 20.775 }, { 115, 0.645, 0.98 },
+			{ 103, 0.636, 4694.003 }, { 102, 0.976, 15720.839 }, { 102, 4.267, 7.114 },
+			{ 99, 6.21, 2146.17 }, { 98, 0.68, 155.42 }, { 86, 5.98, 161000.69 },
+			{ 85, 1.3, 6275.96 }, { 85, 3.67, 71430.7 }, { 80, 1.81, 17260.15 },
+			{ 79, 3.04, 12036.46 }, { 75, 1.76, 5088.63 }, { 74, 3.5, 3154.69 },
+			{ 74, 4.68, 801.82 }, { 70, 0.83, 9437.76 }, { 62, 3.98, 8827.39 },
+			{ 61, 1.82, 7084.9 }, { 57, 2.78, 6286.6 }, { 56, 4.39, 14143.5 },
+			{ 56, 3.47, 6279.55 }, { 52, 0.19, 12139.55 }, { 52, 1.33, 1748.02 },
+			{ 51, 0.28, 5856.48 }, { 49, 0.49, 1194.45 }, { 41, 5.37, 8429.24 },
+			{ 41, 2.4, 19651.05 }, { 39, 6.17, 10447.39 }, { 37, 6.04, 10213.29 },
+			{ 37, 2.57, 1059.38 }, { 36, 1.71, 2352.87 }, { 36, 1.78, 6812.77 },
+			{ 33, 0.59, 17789.85 }, { 30, 0.44, 83996.85 }, { 30, 2.74, 1349.87 },
+			{ 25, 3.16, 4690.48 },
+		};
+		static const VsopTerm L1[] = {
+			{ 628331966747.0, 0, 0 }, { 206059, 2.678235, 6283.07585 }, { 4303, 2.6351, 12566.1517 },
+			{ 425, 1.59, 3.523 }, { 119, 5.796, 26.298 }, { 109, 2.966, 1577.344 },
+			{ 93, 2.59, 18849.23 }, { 72, 1.14, 529.69 }, { 68, 1.87, 398.15 },
+			{ 67, 4.41, 5507.55 }, { 59, 2.89, 5223.69 }, { 56, 2.17, 155.42 },
+			{ 45, 0.4, 796.3 }, { 36, 0.47, 775.52 }, { 29, 2.65, 7.11 },
+			{ 21, 5.34, 0.98 }, { 19, 1.85, 5486.78 }, { 19, 4.97, 213.3 },
+			{ 17, 2.99, 6275.96 }, { 16, 0.03, 2544.31 }, { 16, 1.43, 2146.17 },
+			{ 15, 1.21, 10977.08 }, { 12, 2.83, 1748.02 }, { 12, 3.26, 5088.63 },
+			{ 12, 5.27, 1194.45 }, { 12, 2.08, 4694 }, { 11, 0.77, 553.57 },
+			{ 10, 1.3, 6286.6 }, { 10, 4.24, 1349.87 }, { 9, 2.7, 242.73 },
+			{ 9, 5.64, 951.72 }, { 8, 5.3, 2352.87 }, { 6, 2.65, 9437.76 },
+			{ 6, 4.67, 4690.48 },
+		};
+		static const VsopTerm L2[] = {
+			{ 52919, 0, 0 }, { 8720, 1.0721, 6283.0758 }, { 309, 0.867, 12566.152 },
+			{ 27, 0.05, 3.52 }, { 16, 5.19, 26.3 }, { 16, 3.68, 155.42 },
+			{ 10, 0.76, 18849.23 }, { 9, 2.06, 77713.77 }, { 7, 0.83, 775.52 },
+			{ 5, 4.66, 1577.34 }, { 4, 1.03, 7.11 }, { 4, 3.44, 5573.14 },
+			{ 3, 5.14, 796.3 }, { 3, 6.05, 5507.55 }, { 3, 1.19, 242.73 },
+			{ 3, 6.12, 529.69 }, { 3, 0.31, 398.15 }, { 3, 2.28, 553.57 },
+			{ 2, 4.38, 5223.69 }, { 2, 3.75, 0.98 },
+		};
+		static const VsopTerm L3[] = {
+			{ 289, 5.844, 6283.076 }, { 35, 0, 0 }, { 17, 5.49, 12566.15 },
+			{ 3, 5.2, 155.42 }, { 1, 4.72, 3.52 }, { 1, 5.3, 18849.23 },
+			{ 1, 5.97, 242.73 },
+		};
+		static const VsopTerm L4[] = {
+			{ 114, 3.142, 0 }, { 8, 4.13, 6283.08 }, { 1, 3.84, 12566.15 },
+		};
+		static const VsopTerm L5[] = {
+			{ 1, 3.14, 0 },
+		};
+		static const VsopSeries series = {
+			6, { L0, L1, L2, L3, L4, L5 },
+			{ array_size(L0), array_size(L1), array_size(L2), array_size(L3), array_size(L4), array_size(L5) },
+		};
+		return series;
+	}
+
+	// Heliocentric latitude of the earth, in radians
+	static const VsopSeries& earth_latitude()
+	{
+		static const VsopTerm B0[] = {
+			{ 280, 3.199, 84334.662 }, { 102, 5.422, 5507.553 }, { 80, 3.88, 5223.69 },
+			{ 44, 3.7, 2352.87 }, { 32, 4, 1577.34 },
+		};
+		static const VsopTerm B1[] = {
+			{ 9, 3.9, 5507.55 }, { 6, 1.73, 5223.69 },
+		};
+		static const VsopSeries series = {
+			2, { B0, B1 }, { array_size(B0), array_size(B1) },
+		};
+		return series;
+	}
+
+	// Distance from the earth to the sun, in astronomical units
+	static const VsopSeries& earth_radius()
+	{
+		static const VsopTerm R0[] = {
+			{ 100013989, 0, 0 }, { 1670700, 3.0984635, 6283.07585 }, { 13956, 3.05525, 12566.1517 },
+			{ 3084, 5.1985, 77713.7715 }, { 1628, 1.1739, 5753.3849 }, { 1576, 2.8469, 7860.4194 },
+			{ 925, 5.453, 11506.77 }, { 542, 4.564, 3930.21 }, { 472, 3.661, 5884.927 },
+			{ 346, 0.964, 5507.553 }, { 329, 5.9, 5223.694 }, { 307, 0.299, 5573.143 },
+			{ 243, 4.273, 11790.629 }, { 212, 5.847, 1577.344 }, { 186, 5.022, 10977.079 },
+			{ 175, 3.012, 18849.228 }, { 110, 5.055, 5486.778 }, { 98, 0.89, 6069.78 },
+			{ 86, 5.69, 15720.84 }, { 86, 1.27, 161000.69 }, { 65, 0.27, 17260.15 },
+			{ 63, 0.92, 529.69 }, { 57, 2.01, 83996.85 }, { 56, 5.24, 71430.7 },
+			{ 49, 3.25, 2544.31 }, { 47, 2.58, 775.52 }, { 45, 5.54, 9437.76 },
+			{ 43, 6.01, 6275.96 }, { 39, 5.36, 4694 }, { 38, 2.39, 8827.39 },
+			{ 37, 0.83, 19651.05 }, { 37, 4.9, 12139.55 }, { 36, 1.67, 12036.46 },
+			{ 35, 1.84, 2942.46 }, { 33, 0.24, 7084.9 }, { 32, 0.18, 5088.63 },
+			{ 32, 1.78, 398.15 }, { 28, 1.21, 6286.6 }, { 28, 1.9, 6279.55 },
+			{ 26, 4.59, 10447.39 },
+		};
+		static const VsopTerm R1[] = {
+			{ 103019, 1.10749, 6283.07585 }, { 1721, 1.0644, 12566.1517 }, { 702, 3.142, 0 },
+			{ 32, 1.02, 18849.23 }, { 31, 2.84, 5507.55 }, { 25, 1.32, 5223.69 },
+			{ 18, 1.42, 1577.34 }, { 10, 5.91, 10977.08 }, { 9, 1.42, 6275.96 },
+			{ 9, 0.27, 5486.78 },
+		};
+		static const VsopTerm R2[] = {
+			{ 4359, 5.7846, 6283.0758 }, { 124, 5.579, 12566.152 }, { 12, 3.14, 0 },
+			{ 9, 3.63, 77713.77 }, { 6, 1.87, 5573.14 }, { 3, 5.47, 18849.23 },
+		};
+		static const VsopTerm R3[] = {
+			{ 145, 4.273, 6283.076 }, { 7, 3.92, 12566.15 },
+		};
+		static const VsopTerm R4[] = {
+			{ 4, 2.56, 6283.08 },
+		};
+		static const VsopSeries series = {
+			5, { R0, R1, R2, R3, R4 },
+			{ array_size(R0), array_size(R1), array_size(R2), array_size(R3), array_size(R4) },
+		};
+		return series;
+	}
+
+	template <int N>
+	static constexpr int array_size(const VsopTerm (&)[N])
+	{
+		return N;
+	}
+
+	double start;
+	int count;
+	bool precise;
+	std::vector<std::pair<double, double> > positions;
+};
+
+// Location to compute prayer times for
+struct Location
+{
+	double latitude;
+	double longitude;
+	double elevation;
+	double timezone;
+};
+
+// Source of the timezone of locations given without one, for instance
+// TimeZoneMap of tzmap.hpp
+class TimeZoneResolver
+{
+public:
+	virtual ~TimeZoneResolver()
+	{
+	}
+
+	// Get the timezone in hours of a location on a Gregorian date
+	virtual double get_timezone(double latitude, double longitude, int year, int month, int day) const = 0;
+};
+
+// Source of the elevation of locations given without one, for instance
+// ElevationMap of dem.hpp
+class ElevationResolver
+{
+public:
+	virtual ~ElevationResolver()
+	{
+	}
+
+	// Get the elevation in meters of a location, or NAN if it isn't known
+	virtual double get_elevation(double latitude, double longitude) const = 0;
+};
+
+// The get functions of PrayerTimes don't modify the object and only use
+// reentrant time functions, so once configured, a single instance can be
+// used by any number of threads at the same time.
 class PrayerTimes
 {
 public:
@@ -169,14 +671,8 @@ public:
 			AsrJuristicsMethod asr_juristics_method = StandardAsr, double asr = 0.0,		// Set asr if the method is minutes
 			HighLatitudeMethod high_latitudes_method = NightMiddle)
 	{
-		method_params[MWL]     = { true, 10.0, false, 18.0, true, 0.0, true,  0.0, false, 17.0, StandardMidnight };
-		method_params[ISNA]    = { true, 10.0, false, 15.0, true, 0.0, true,  0.0, false, 15.0, StandardMidnight };
-		method_params[Egypt]   = { true, 10.0, false, 19.5, true, 0.0, true,  0.0, false, 17.5, StandardMidnight };
-		method_params[Makkah]  = { true, 10.0, false, 19.0, true, 0.0, true,  0.0, true,  90.0, StandardMidnight };
-		method_params[Karachi] = { true, 10.0, false, 18.0, true, 0.0, true,  0.0, false, 18.0, StandardMidnight };
-		method_params[Tehran]  = { true, 10.0, false, 17.7, true, 0.0, false, 4.5, false, 14.0, JafariMidnight   };
-		method_params[Jafari]  = { true, 10.0, false, 16.0, true, 0.0, false, 4.0, false, 14.0, JafariMidnight   };
-		method_params[Custom]  = { true, 10.0, false, 15.0, true, 0.0, true,  0.0, false, 15.0, StandardMidnight };
+		for (int i = 0; i < CalculationMethodsCount; ++i)
+			method_params[i] = default_method_params()[i];
 
 		for (int i = 0; i < TimesCount; ++i)
 			time_offsets[i] = 0.0;
@@ -185,33 +681,281 @@ public:
 		settings.asr = asr;
 		settings.high_latitudes_method = high_latitudes_method;
 
+		ephemeris = NULL;
+		timezone_resolver = NULL;
+		elevation_resolver = NULL;
+		fast_trig = false;
+		convergence_tolerance = 1.0;
+		max_iterations = NUM_ITERATIONS;
+		precision = FastPrecision;
+		hybrid_margin = 5.0;
+
 		set_calc_method(calc_method);
 	}
 
+	// Return prayer times for a given date and location
+	// If the timezone of the location is NAN, it is asked to the timezone
+	// resolver, see set_timezone_resolver(), or else the local one is used,
+	// and a NAN elevation is asked to the elevation resolver.
+	void get_prayer_times(int year, int month, int day, const Location& location, double times[]) const
+	{
+		Context context = make_context(resolve_location(location, year, month, day), julian(year, month, day),
+				precise_positions(1));
+		compute_times(context, times);
+	}
+
+	// Same as above, also storing in iterations the number of iterations
+	// each time took, 0 for times given in minutes and for Midnight
+	void get_prayer_times(int year, int month, int day, const Location& location, double times[],
+			int iterations[]) const
+	{
+		Context context = make_context(resolve_location(location, year, month, day), julian(year, month, day),
+				precise_positions(1));
+		compute_times(context, times, iterations);
+	}
+
 	// Return prayer times for a given date
 	void get_prayer_times(int year, int month, int day,
 			double latitude, double longitude, double elevation,
-			double timezone, double times[])
+			double timezone, double times[]) const
 	{
-		this->latitude = latitude;
-		this->longitude = longitude;
-		this->elevation = elevation;
-		this->timezone = timezone;
-		julian_date = julian(year, month, day) - longitude / (double) (15 * 24);
-		compute_times(times);
+		Location location = { latitude, longitude, elevation, timezone };
+		get_prayer_times(year, month, day, location, times);
 	}
 
 	// Facility function to get date as a single time_t instead of separate parts
-	void get_prayer_times(time_t date, double latitude, double longitude, double elevation, double timezone, double times[])
+	void get_prayer_times(time_t date, double latitude, double longitude, double elevation, double timezone, double times[]) const
 	{
-		tm* t = localtime(&date);
-		get_prayer_times(1900 + t->tm_year, t->tm_mon + 1, t->tm_mday, latitude, longitude, elevation, timezone, times);
+		tm t;
+		localtime_r(&date, &t);
+		get_prayer_times(1900 + t.tm_year, t.tm_mon + 1, t.tm_mday, latitude, longitude, elevation, timezone, times);
+	}
+
+	// Return prayer times of a given date for many locations at once
+	// Location parameters are given as contiguous arrays of count elements
+	// and times must have room for count * TimesCount elements, the times of
+	// location i being stored at times[i * TimesCount]. NAN timezones are
+	// asked to the timezone resolver, or else replaced by the local one, and
+	// NAN elevations are asked to the elevation resolver.
+	void get_prayer_times(int year, int month, int day, size_t count,
+			const double latitudes[], const double longitudes[], const double elevations[],
+			const double timezones[], double times[]) const
+	{
+		double jd = julian(year, month, day);
+
+		// Share sun positions between locations unless the caller provides them
+		bool precise = precise_positions(1, count);
+		SolarEphemeris day_ephemeris;
+		if (!ephemeris_matches(ephemeris, precise))
+			day_ephemeris = SolarEphemeris(jd, 1, precise);
+
+		// Looked up once for all locations without a timezone
+		double local_timezone = NAN;
+
+		for (size_t i = 0; i < count; i += BATCH_WIDTH)
+		{
+			int n = count - i < (size_t) BATCH_WIDTH ? count - i : BATCH_WIDTH;
+			BatchBlock block;
+			block.ephemeris = ephemeris_matches(ephemeris, precise) ? ephemeris : &day_ephemeris;
+			block.precise = precise;
+			for (int k = 0; k < n; ++k)
+			{
+				block.latitude[k] = latitudes[i + k];
+				block.longitude[k] = longitudes[i + k];
+				block.elevation[k] = std::isnan(elevations[i + k]) ?
+					resolve_elevation(latitudes[i + k], longitudes[i + k]) : elevations[i + k];
+				block.timezone[k] = timezones[i + k];
+				if (std::isnan(timezones[i + k]) && timezone_resolver)
+					block.timezone[k] = timezone_resolver->get_timezone(latitudes[i + k], longitudes[i + k],
+							year, month, day);
+				else if (std::isnan(timezones[i + k]))
+				{
+					if (std::isnan(local_timezone))
+						local_timezone = julian_timezone(jd);
+					block.timezone[k] = local_timezone;
+				}
+				block.julian_date[k] = jd - longitudes[i + k] / (double) (15 * 24);
+			}
+			batch_compute_times(block, n);
+			for (int k = 0; k < n; ++k)
+				for (int j = 0; j < TimesCount; ++j)
+					times[(i + k) * TimesCount + j] = block.times[j][k];
+		}
+	}
+
+	// Return prayer times of a single location for a range of consecutive days
+	// starting at a given date. times must have room for days * TimesCount
+	// elements, the times of day d being stored at times[d * TimesCount].
+	// Each day is seeded from the times of the previous one. If timezone is
+	// NAN, the timezone of every day is asked to the timezone resolver, or
+	// else the local one is looked up, including daylight saving changes
+	// within the range. A NAN elevation is asked to the elevation resolver.
+	// If iterations isn't NULL, it gets the number of iterations of each
+	// time, laid out like times.
+	void get_prayer_times_range(int year, int month, int day, int days,
+			double latitude, double longitude, double elevation,
+			double timezone, double times[], int iterations[] = NULL) const
+	{
+		std::vector<double> timezones(days, timezone);
+		if (std::isnan(timezone) && timezone_resolver)
+		{
+			double jd = julian(year, month, day);
+			for (int d = 0; d < days; ++d)
+			{
+				int day_year, day_month, day_day;
+				gregorian(jd + d, day_year, day_month, day_day);
+				timezones[d] = timezone_resolver->get_timezone(latitude, longitude, day_year, day_month, day_day);
+			}
+		}
+		else if (std::isnan(timezone) && days > 0)
+			get_timezones(julian(year, month, day), days, &timezones[0]);
+		get_prayer_times_range(year, month, day, days, latitude, longitude, elevation,
+				days > 0 ? &timezones[0] : NULL, times, iterations);
+	}
+
+	// Same as above with the timezone of each day given, for instance by
+	// TimeZone::get_timezones() of tzfile.hpp
+	void get_prayer_times_range(int year, int month, int day, int days,
+			double latitude, double longitude, double elevation,
+			const double timezones[], double times[], int iterations[] = NULL) const
+	{
+		double jd = julian(year, month, day);
+		if (std::isnan(elevation))
+			elevation = resolve_elevation(latitude, longitude);
+
+		// Share sun positions between days unless the caller provides them
+		bool precise = precise_positions(days);
+		SolarEphemeris range_ephemeris;
+		if (!ephemeris_matches(ephemeris, precise))
+			range_ephemeris = SolarEphemeris(jd, days, precise);
+
+		Location location = { latitude, longitude, elevation, days > 0 ? timezones[0] : 0.0 };
+		Context context = make_context(location, jd, precise, &range_ephemeris);
+		ComputeRange function = { *this, context, jd, days, timezones, times, iterations };
+		dispatch(function);
 	}
 
 	//------------------ Configuration Functions -------------------
 
+	// Get the ephemeris table used for sun positions, if any
+	const SolarEphemeris* get_ephemeris() const
+	{
+		return ephemeris;
+	}
+
+	// Use a shared ephemeris table for sun positions it covers, instead of
+	// computing them, or stop using any if NULL. The table must outlive its use
+	// and is only used if it is precise in HighPrecision, and not in
+	// FastPrecision. HybridPrecision uses either, computing with the precise
+	// sun position from a precise table as it then needs no refinement.
+	void set_ephemeris(const SolarEphemeris* new_ephemeris)
+	{
+		ephemeris = new_ephemeris;
+	}
+
+	// Get the source of the timezone of locations given without one, if any
+	const TimeZoneResolver* get_timezone_resolver() const
+	{
+		return timezone_resolver;
+	}
+
+	// Find the timezone of locations given with a NAN timezone from their
+	// coordinates, or stop doing so if NULL. The resolver must outlive its use
+	// and be usable from all threads sharing this object.
+	void set_timezone_resolver(const TimeZoneResolver* new_timezone_resolver)
+	{
+		timezone_resolver = new_timezone_resolver;
+	}
+
+	// Get the source of the elevation of locations given without one, if any
+	const ElevationResolver* get_elevation_resolver() const
+	{
+		return elevation_resolver;
+	}
+
+	// Find the elevation of locations given with a NAN elevation from their
+	// coordinates, or stop doing so if NULL, in which case they are taken at
+	// sea level, as are those the resolver doesn't know. The resolver must
+	// outlive its use and be usable from all threads sharing this object.
+	void set_elevation_resolver(const ElevationResolver* new_elevation_resolver)
+	{
+		elevation_resolver = new_elevation_resolver;
+	}
+
+	// Get whether batch computations use fast trigonometry
+	bool get_fast_trig() const
+	{
+		return fast_trig;
+	}
+
+	// Use the vectorized approximations of DMathSimd instead of libm for the
+	// trigonometry of batch computations. Times move by less than a
+	// microsecond. Single location computations always use libm.
+	void set_fast_trig(bool new_fast_trig)
+	{
+		fast_trig = new_fast_trig;
+	}
+
+	// Get the convergence settings of the iterative computation
+	void get_convergence(double& tolerance, int& iterations) const
+	{
+		tolerance = convergence_tolerance;
+		iterations = max_iterations;
+	}
+
+	// Iterate each time until it moves by at most tolerance seconds, or for
+	// at most a number of iterations. The default single iteration matches
+	// earlier versions, while times near the poles need a few more to settle.
+	// HybridPrecision allows at least HYBRID_ITERATIONS.
+	void set_convergence(double tolerance, int iterations)
+	{
+		convergence_tolerance = tolerance;
+		max_iterations = iterations < 1 ? 1 : iterations;
+	}
+
+	// Get the precision of the computation
+	Precision get_precision() const
+	{
+		return precision;
+	}
+
+	// Set the precision of the computation. HighPrecision computes the sun
+	// position with the more expensive solar theory of Meeus and the dip of
+	// the horizon from the exact geometric formula. HybridPrecision uses the
+	// exact dip and iterates times to convergence with the fast sun position,
+	// then computes again with the precise one the times which may be close
+	// to a whole minute, so that times truncated to minutes match those of
+	// HighPrecision iterated to convergence, up to the convergence tolerance.
+	// As most days have such a time, computing one costs about a third of
+	// converged HighPrecision. When a precise table provides the sun
+	// positions, either configured or sampled for a range of days or many
+	// locations, HybridPrecision computes with them directly, at the cost of
+	// FastPrecision.
+	void set_precision(Precision new_precision)
+	{
+		precision = new_precision;
+	}
+
+	// Get the distance to a whole minute under which HybridPrecision refines
+	// times, in seconds
+	double get_hybrid_margin() const
+	{
+		return hybrid_margin;
+	}
+
+	// Set the distance to a whole minute under which HybridPrecision refines
+	// times, in seconds. Times truncated to minutes match HighPrecision as
+	// long as it exceeds the shift the difference between both equations of
+	// time causes, at most 3.4 seconds over years 1900-2100. The margin of
+	// each time is widened by the shift the difference between declinations
+	// may cause, which grows where the sun barely reaches its angle.
+	void set_hybrid_margin(double margin)
+	{
+		hybrid_margin = margin;
+	}
+
 	// Get current calculation method
-	CalculationMethod get_calc_method()
+	CalculationMethod get_calc_method() const
 	{
 		return calc_method;
 	}
@@ -224,7 +968,7 @@ public:
 	}
 
 	// Get current time offsets
-	void get_time_offsets(double times[])
+	void get_time_offsets(double times[]) const
 	{
 		for (int i = 0; i < TimesCount; ++i)
 			times[i] = time_offsets[i];
@@ -305,17 +1049,53 @@ public:
 		calc_method = Custom;
 	}
 
+	//---------------------- Date Functions ----------------------
+
+	// convert Gregorian date to Julian day
+	// Ref: Astronomical Algorithms by Jean Meeus
+	static double julian(int year, int month, int day)
+	{
+		while (month <= 2)
+		{
+			year -= 1;
+			month += 12;
+		}
+
+		double a = floor(year / 100.0);
+		double b = 2 - a + floor(a / 4.0);
+
+		return floor(365.25 * (year + 4716)) + floor(30.6001 * (month + 1)) + day + b - 1524.5;
+	}
+
+	// convert Julian day to Gregorian date
+	// Ref: Astronomical Algorithms by Jean Meeus
+	static void gregorian(double jd, int& year, int& month, int& day)
+	{
+		double z = floor(jd + 0.5);
+		double alpha = floor((z - 1867216.25) / 36524.25);
+		double a = z + 1 + alpha - floor(alpha / 4.0);
+		double b = a + 1524;
+		double c = floor((b - 122.1) / 365.25);
+		double d = floor(365.25 * c);
+		double e = floor((b - d) / 30.6001);
+
+		day = b - d - floor(30.6001 * e);
+		month = e < 14 ? e - 1 : e - 13;
+		year = month > 2 ? c - 4716 : c - 4715;
+	}
+
 	//-------------------- Timezone Functions --------------------
 
 	// Compute local timezone for a specific Gregorian local timestamp
 	static double get_timezone(time_t local_time)
 	{
-		tm* tmp = localtime(&local_time);
-		tmp->tm_isdst = 0;
-		time_t local = mktime(tmp);
-		tmp = gmtime(&local_time);
-		tmp->tm_isdst = 0;
-		time_t gmt = mktime(tmp);
+		tm tmp;
+		localtime_r(&local_time, &tmp);
+		tmp.tm_isdst = 0;
+		time_t local = mktime(&tmp);
+		gmtime_r(&local_time, &tmp);
+		tmp.tm_isdst = 0;
+		time_t gmt = mktime(&tmp);
 		return (local - gmt) / 3600.0;
 	}
 
@@ -335,105 +1115,486 @@ public:
 		return get_timezone(local);
 	}
 
+	// Compute local timezone for each of a range of consecutive days
+	// starting at a given julian date. Instead of asking libc for every day,
+	// the timezone is probed every TZ_PROBE_DAYS days and changes between
+	// two probes are located by bisection.
+	static void get_timezones(double jd, int days, double timezones[])
+	{
+		int last = 0;
+		double last_timezone = julian_timezone(jd);
+		timezones[0] = last_timezone;
+
+		while (last < days - 1)
+		{
+			int probe = last + TZ_PROBE_DAYS < days - 1 ? last + TZ_PROBE_DAYS : days - 1;
+			double probe_timezone = julian_timezone(jd + probe);
+
+			// Find the first day having the timezone of the probe
+			int first = probe;
+			if (probe_timezone != last_timezone)
+			{
+				int low = last;
+				while (first - low > 1)
+				{
+					int middle = (low + first) / 2;
+					if (julian_timezone(jd + middle) == last_timezone)
+						low = middle;
+					else
+						first = middle;
+				}
+			}
+
+			for (int d = last + 1; d <= probe; ++d)
+				timezones[d] = d < first ? last_timezone : probe_timezone;
+
+			last = probe;
+			last_timezone = probe_timezone;
+		}
+	}
+
+	// Compute local timezone for a specific julian date
+	static double julian_timezone(double jd)
+	{
+		int year, month, day;
+		gregorian(jd, year, month, day);
+		return get_timezone(year, month, day);
+	}
+
 protected:
+	// State of a single computation, passed along instead of being stored
+	// in the object
+	struct Context : public Location
+	{
+		double julian_date;
+		const SolarEphemeris* ephemeris;
+		bool precise;		// Whether to use the precise sun position
+		bool refine;		// Whether to refine times close to a minute boundary
+		double rise_set;		// Sun angle at sunrise and sunset
+		double sin_latitude;
+		double cos_latitude;
+	};
+
+	// Position of the sun at a time estimate, along with the trigonometry
+	// shared by every event estimated at that time
+	struct SolarContext
+	{
+		double equation;
+		double declination;
+		double sin_declination;
+		double cos_declination;
+	};
+
+	// Solar contexts of the distinct time estimates of an iteration
+	struct SolarCache
+	{
+		int count;
+		double times[TimesCount];
+		SolarContext solar[TimesCount];
+	};
+
+	// Copy of a location, with its timezone asked to the timezone resolver,
+	// or else the local one, and its elevation to the elevation resolver if
+	// they are NAN
+	Location resolve_location(const Location& location, int year, int month, int day) const
+	{
+		Location resolved = location;
+		if (std::isnan(location.timezone) && timezone_resolver)
+			resolved.timezone = timezone_resolver->get_timezone(location.latitude, location.longitude,
+					year, month, day);
+		else if (std::isnan(location.timezone))
+			resolved.timezone = julian_timezone(julian(year, month, day));
+		if (std::isnan(location.elevation))
+			resolved.elevation = resolve_elevation(location.latitude, location.longitude);
+		return resolved;
+	}
+
+	// Elevation of a location given without one, at sea level if unknown
+	double resolve_elevation(double latitude, double longitude) const
+	{
+		double elevation = elevation_resolver ? elevation_resolver->get_elevation(latitude, longitude) : NAN;
+		return std::isnan(elevation) ? 0.0 : elevation;
+	}
+
+	// Set up the computation of a location at a given julian date, with the
+	// precise sun position or not, using the configured ephemeris table or
+	// else the given one
+	Context make_context(const Location& location, double jd, bool precise,
+			const SolarEphemeris* fallback_ephemeris = NULL) const
+	{
+		Context context;
+		static_cast<Location&>(context) = location;
+		context.julian_date = jd - location.longitude / (double) (15 * 24);
+		context.ephemeris = ephemeris_matches(ephemeris, precise) ? ephemeris : fallback_ephemeris;
+		context.precise = precise;
+		context.refine = precision == HybridPrecision && !precise;
+		context.rise_set = rise_set_angle(location.elevation, precision != FastPrecision);
+		context.sin_latitude = DMath::sin(location.latitude);
+		context.cos_latitude = DMath::cos(location.latitude);
+		return context;
+	}
+
+	// Whether an ephemeris table holds sun positions of the given precision
+	static bool ephemeris_matches(const SolarEphemeris* table, bool precise)
+	{
+		return table && table->is_precise() == precise;
+	}
+
+	// Whether to compute the times of a number of days, for a number of
+	// locations, with the precise sun position. HybridPrecision does when
+	// the configured ephemeris table is precise, or when a table for these
+	// days samples fewer precise positions than refining their times would
+	// compute, since interpolating a table costs no more than computing the
+	// fast position and leaves nothing to refine.
+	bool precise_positions(int days, int count = 1) const
+	{
+		if (precision != HybridPrecision)
+			return precision == HighPrecision;
+		return ephemeris_matches(ephemeris, true) ||
+			SolarEphemeris::samples(days) < days * count * HYBRID_REFINED_POSITIONS;
+	}
+
+	// Maximum number of iterations of a time. HybridPrecision iterates times
+	// to convergence, since it must know them to the second to find those
+	// close to a minute boundary.
+	int iteration_limit() const
+	{
+		return precision == HybridPrecision && max_iterations < HYBRID_ITERATIONS ?
+			HYBRID_ITERATIONS : max_iterations;
+	}
+
+	//------------------------ Method Dispatch -------------------------
+
+	// Call function with the StaticSettings matching settings, or with
+	// RuntimeSettings if they have been customized. Settings are compared
+	// on each call since they may be modified directly.
+	template <class Function>
+	void dispatch(const Function& function) const
+	{
+		if (calc_method == Custom || settings.asr_juristics_method == MinutesAsr ||
+				!same_method_config(settings, method_config(calc_method)))
+		{
+			function(RuntimeSettings(settings));
+			return;
+		}
+
+		switch (calc_method)
+		{
+			case MWL:     dispatch_asr<MWL>(function);     break;
+			case ISNA:    dispatch_asr<ISNA>(function);    break;
+			case Egypt:   dispatch_asr<Egypt>(function);   break;
+			case Makkah:  dispatch_asr<Makkah>(function);  break;
+			case Karachi: dispatch_asr<Karachi>(function); break;
+			case Jafari:  dispatch_asr<Jafari>(function);  break;
+			case Tehran:  dispatch_asr<Tehran>(function);  break;
+			default:      function(RuntimeSettings(settings));
+		}
+	}
+
+	template <CalculationMethod M, class Function>
+	void dispatch_asr(const Function& function) const
+	{
+		if (settings.asr_juristics_method == HanafiAsr)
+			dispatch_high_latitudes<M, HanafiAsr>(function);
+		else
+			dispatch_high_latitudes<M, StandardAsr>(function);
+	}
+
+	template <CalculationMethod M, AsrJuristicsMethod A, class Function>
+	void dispatch_high_latitudes(const Function& function) const
+	{
+		switch (settings.high_latitudes_method)
+		{
+			case NightMiddle: function(StaticSettings<M, A, NightMiddle>()); break;
+			case AngleBased:  function(StaticSettings<M, A, AngleBased>());  break;
+			case OneSeventh:  function(StaticSettings<M, A, OneSeventh>());  break;
+			default:          function(StaticSettings<M, A, None>());
+		}
+	}
+
+	static bool same_method_config(const MethodConfig& a, const MethodConfig& b)
+	{
+		return a.imsak_is_minutes == b.imsak_is_minutes && a.imsak == b.imsak &&
+			a.fajr_is_minutes == b.fajr_is_minutes && a.fajr == b.fajr &&
+			a.dhuhr_is_minutes == b.dhuhr_is_minutes && a.dhuhr == b.dhuhr &&
+			a.maghrib_is_minutes == b.maghrib_is_minutes && a.maghrib == b.maghrib &&
+			a.isha_is_minutes == b.isha_is_minutes && a.isha == b.isha &&
+			a.midnight_method == b.midnight_method;
+	}
+
+	struct ComputeTimes
+	{
+		const PrayerTimes& prayer_times;
+		const Context& context;
+		double* times;
+		int* iterations;
+
+		template <class Config>
+		void operator()(const Config& config) const
+		{
+			prayer_times.compute_times(context, config, times, iterations);
+		}
+	};
+
+	struct ComputeRange
+	{
+		const PrayerTimes& prayer_times;
+		Context& context;
+		double julian_date;
+		int days;
+		const double* timezones;
+		double* times;
+		int* iterations;
+
+		template <class Config>
+		void operator()(const Config& config) const
+		{
+			prayer_times.compute_range_times(context, config, julian_date, days, timezones, times, iterations);
+		}
+	};
+
 	//---------------------- Calculation Functions -----------------------
 
+	// Compute the sun position at a time estimate
+	static SolarContext solar_context(const Context& context, double time)
+	{
+		std::pair<double, double> position = sun_position(context.ephemeris, context.julian_date + time,
+				context.precise);
+		SolarContext solar;
+		solar.equation = position.first;
+		solar.declination = position.second;
+		solar.sin_declination = DMath::sin(solar.declination);
+		solar.cos_declination = DMath::cos(solar.declination);
+		return solar;
+	}
+
+	// Get the sun position at a time estimate, computing it only if no
+	// other event of the iteration had the same estimate
+	static const SolarContext& solar_context(const Context& context, SolarCache& cache, double time)
+	{
+		for (int i = 0; i < cache.count; ++i)
+			if (cache.times[i] == time)
+				return cache.solar[i];
+		cache.times[cache.count] = time;
+		cache.solar[cache.count] = solar_context(context, time);
+		return cache.solar[cache.count++];
+	}
+
 	// Compute mid-day time
-	double mid_day(double time)
+	static double mid_day(const SolarContext& solar)
 	{
-		double equation = sun_position(julian_date + time).first;
-		double noon = DMath::fix_hour(12.0 - equation);
+		double noon = DMath::fix_hour(12.0 - solar.equation);
 		return noon;
 	}
 
+	double mid_day(const Context& context, double time) const
+	{
+		return mid_day(solar_context(context, time));
+	}
+
 	// Compute the time at which sun reaches a specific angle below horizon
-	double sun_angle_time(double angle, double time, bool direction_is_ccw = false)
+	static double sun_angle_time(const Context& context, const SolarContext& solar, double angle,
+			bool direction_is_ccw = false)
 	{
-		double declination = sun_position(julian_date + time).second;
 		double t = DMath::arccos((-DMath::sin(angle) -
-					DMath::sin(declination) * DMath::sin(latitude)) /
-				(DMath::cos(declination) * DMath::cos(latitude))) / 15.0;
-		double noon = mid_day(time);
+					solar.sin_declination * context.sin_latitude) /
+				(solar.cos_declination * context.cos_latitude)) / 15.0;
+		double noon = mid_day(solar);
 		return noon + (direction_is_ccw ? -t : t);
 	}
 
-	// Compute Asr time 
-	double asr_time(double factor, double time)
-	{ 
-		double declination = sun_position(julian_date + time).second;
-		double angle = -DMath::arccot(factor + DMath::tan(::fabs(latitude - declination)));
-		return sun_angle_time(angle, time);
+	double sun_angle_time(const Context& context, double angle, double time, bool direction_is_ccw = false) const
+	{
+		return sun_angle_time(context, solar_context(context, time), angle, direction_is_ccw);
 	}
 
-	// Compute declination angle of sun and equation of time
-	// Ref: http://aa.usno.navy.mil/faq/docs/SunApprox.php
-	std::pair<double, double> sun_position(double jd)
+	// Compute Asr time
+	static double asr_time(const Context& context, const SolarContext& solar, double factor)
 	{
-		double D = jd - 2451545.0;
-		double g = DMath::fix_angle(357.529 + 0.98560028 * D);
-		double q = DMath::fix_angle(280.459 + 0.98564736 * D);
-		double L = DMath::fix_angle(q + 1.915* DMath::sin(g) + 0.020 * DMath::sin(2 * g));
+		double angle = -DMath::arccot(factor + DMath::tan(::fabs(context.latitude - solar.declination)));
+		return sun_angle_time(context, solar, angle);
+	}
 
-		// double R = 1.00014 - 0.01671* DMath::cos(g) - 0.00014 * DMath::cos(2 * g);
-		double e = 23.439 - 0.00000036 * D;
+	double asr_time(const Context& context, double factor, double time) const
+	{
+		return asr_time(context, solar_context(context, time), factor);
+	}
 
-		double RA = DMath::arctan2(DMath::cos(e) * DMath::sin(L), DMath::cos(L)) / 15.0;
-		double equation = q / 15.0 - DMath::fix_hour(RA);
-		double declination = DMath::arcsin(DMath::sin(e) * DMath::sin(L));
-		return { equation, declination };
+	// Compute declination angle of sun and equation of time, from the
+	// ephemeris table when it covers jd with the requested precision
+	static std::pair<double, double> sun_position(const SolarEphemeris* table, double jd, bool precise = false)
+	{
+		if (table && table->is_precise() == precise && table->contains(jd))
+			return table->sun_position(jd);
+		return precise ? SolarEphemeris::compute_precise_sun_position(jd) : SolarEphemeris::compute_sun_position(jd);
 	}
 
-	// convert Gregorian date to Julian day
-	// Ref: Astronomical Algorithms by Jean Meeus
-	double julian(int year, int month, int day)
+	//---------------------- Compute Prayer Times -----------------------
+
+	// Array of times must have at least TimesCount elements
+
+	// Compute a single time from the sun position at its estimate
+	template <class Config>
+	double compute_time(const Context& context, const Config& config, int time, const SolarContext& solar) const
 	{
-		while (month <= 2)
+		switch (time)
 		{
-			year -= 1;
-			month += 12;
+			case Imsak:
+				return sun_angle_time(context, solar, config.imsak(), true);
+			case Fajr:
+				return sun_angle_time(context, solar, config.fajr(), true);
+			case Sunrise:
+				return sun_angle_time(context, solar, context.rise_set, true);
+			case Dhuhr:
+				return mid_day(solar);
+			case Asr:
+				return asr_time(context, solar, asr_factor(config));
+			case Sunset:
+				return sun_angle_time(context, solar, context.rise_set);
+			case Maghrib:
+				return sun_angle_time(context, solar, config.maghrib());
+			default:
+				return sun_angle_time(context, solar, config.isha());
 		}
-
-		double a = floor(year / 100.0);
-		double b = 2 - a + floor(a / 4.0);
-
-		return floor(365.25 * (year + 4716)) + floor(30.6001 * (month + 1)) + day + b - 1524.5;
 	}
 
-	//---------------------- Compute Prayer Times -----------------------
+	// Whether a time is given in minutes after or before another one
+	template <class Config>
+	static bool is_minutes_time(const Config& config, int time)
+	{
+		return (time == Imsak && config.imsak_is_minutes()) ||
+			(time == Maghrib && config.maghrib_is_minutes()) ||
+			(time == Isha && config.isha_is_minutes());
+	}
 
-	// Array of times must have at least TimesCount elements
+	// Estimate times given in minutes from the time they follow, adjust_times
+	// sets them
+	template <class Config>
+	static void estimate_minutes_times(const Config& config, double times[])
+	{
+		if (config.imsak_is_minutes())
+			times[Imsak] = times[Fajr];
+		if (config.maghrib_is_minutes())
+			times[Maghrib] = times[Sunset];
+		if (config.isha_is_minutes())
+			times[Isha] = times[Maghrib];
+	}
 
 	// Compute prayer times at given julian date
-	void compute_prayer_times(double times[])
+	// The sun position is computed once for each distinct time estimate.
+	template <class Config>
+	void compute_prayer_times(const Context& context, const Config& config, double times[]) const
 	{
 		day_portion(times);
 
-		times[Imsak]   = sun_angle_time(settings.imsak, times[Imsak], true);
-		times[Fajr]    = sun_angle_time(settings.fajr, times[Fajr], true);
-		times[Sunrise] = sun_angle_time(rise_set_angle(), times[Sunrise], true);  
-		times[Dhuhr]   = mid_day(times[Dhuhr]);
-		times[Asr]     = asr_time(asr_factor(settings.asr), times[Asr]);
-		times[Sunset]  = sun_angle_time(rise_set_angle(), times[Sunset]);
-		times[Maghrib] = sun_angle_time(settings.maghrib, times[Maghrib]);
-		times[Isha]    = sun_angle_time(settings.isha, times[Isha]);
+		SolarCache cache;
+		cache.count = 0;
+		for (int i = 0; i < Midnight; ++i)
+			if (!is_minutes_time(config, i))
+				times[i] = compute_time(context, config, i, solar_context(context, cache, times[i]));
+
+		estimate_minutes_times(config, times);
+	}
+
+	// Iterate prayer times from their estimates until each of them moves by
+	// at most convergence_tolerance seconds, or for max_iterations. The first
+	// iteration computes all times at once, the next ones only those still
+	// moving. If iterations isn't NULL, it gets the number of iterations of
+	// each time.
+	template <class Config>
+	void iterate_times(const Context& context, const Config& config, double times[], int iterations[]) const
+	{
+		double previous[TimesCount];
+		for (int i = 0; i < TimesCount; ++i)
+			previous[i] = times[i];
+
+		compute_prayer_times(context, config, times);
+
+		for (int i = 0; i < Midnight; ++i)
+		{
+			if (is_minutes_time(config, i))
+			{
+				if (iterations)
+					iterations[i] = 0;
+				continue;
+			}
+
+			int count = 1;
+			while (count < iteration_limit() && !std::isnan(times[i]) &&
+					::fabs(times[i] - previous[i]) * 3600.0 > convergence_tolerance)
+			{
+				previous[i] = times[i];
+				times[i] = compute_time(context, config, i, solar_context(context, times[i] / 24.0));
+				++count;
+			}
+			if (iterations)
+				iterations[i] = count;
+		}
+		if (iterations)
+			iterations[Midnight] = 0;
+
+		estimate_minutes_times(config, times);
 	}
 
 	// Compute prayer times
-	void compute_times(double times[])
+	void compute_times(const Context& context, double times[], int iterations[] = NULL) const
 	{
-		static const double default_times[] = { 5, 5, 6, 12, 13, 18, 18, 18 };
+		ComputeTimes function = { *this, context, times, iterations };
+		dispatch(function);
+	}
 
+	template <class Config>
+	void compute_times(const Context& context, const Config& config, double times[], int iterations[]) const
+	{
 		for (int i = 0; i < TimesCount; ++i)
-			times[i] = default_times[i];
+			times[i] = default_times()[i];
+
+		iterate_times(context, config, times, iterations);
+		if (context.refine)
+			finalize_hybrid_times(context, config, times);
+		else
+			finalize_times(context, config, times);
+	}
 
-		// Main iterations
-		for (int i = 1; i <= NUM_ITERATIONS; ++i) 
-			compute_prayer_times(times);
+	// Compute prayer times of consecutive days starting at julian date jd
+	// Each day is seeded from the times of the previous one.
+	template <class Config>
+	void compute_range_times(Context& context, const Config& config, double jd, int days,
+			const double timezones[], double times[], int iterations[]) const
+	{
+		double estimates[TimesCount];
+		for (int i = 0; i < TimesCount; ++i)
+			estimates[i] = default_times()[i];
+
+		for (int d = 0; d < days; ++d)
+		{
+			double* day_times = times + d * TimesCount;
+			context.timezone = timezones[d];
+			context.julian_date = jd + d - context.longitude / (double) (15 * 24);
+
+			for (int i = 0; i < TimesCount; ++i)
+				day_times[i] = std::isnan(estimates[i]) ? default_times()[i] : estimates[i];
+
+			iterate_times(context, config, day_times, iterations ? iterations + d * TimesCount : NULL);
+
+			for (int i = 0; i < TimesCount; ++i)
+				estimates[i] = day_times[i];
+
+			if (context.refine)
+				finalize_hybrid_times(context, config, day_times);
+			else
+				finalize_times(context, config, day_times);
+		}
+	}
 
-		adjust_times(times);
+	// Turn the iterated times into local times in seconds
+	template <class Config>
+	void finalize_times(const Context& context, const Config& config, double times[]) const
+	{
+		adjust_times(context, config, times);
 
 		// Add midnight time
-		if (settings.midnight_method == JafariMidnight)
+		if (config.midnight_method() == JafariMidnight)
 			times[Midnight] = times[Sunset] + time_diff(times[Maghrib], times[Fajr]) / 2.0;
 		else
 			times[Midnight] = times[Sunset] + time_diff(times[Sunset], times[Sunrise]) / 2.0;
@@ -442,94 +1603,252 @@ protected:
 		modify_formats(times);
 	}
 
-	void adjust_times(double times[])
+	// Finalize times, then refine those close to a minute boundary
+	template <class Config>
+	void finalize_hybrid_times(const Context& context, const Config& config, double times[]) const
 	{
+		double raw[TimesCount];
 		for (int i = 0; i < TimesCount; ++i)
-			times[i] += timezone - longitude / 15.0;
+			raw[i] = times[i];
 
-		if (settings.high_latitudes_method != None)
-			adjust_high_latitudes(times);
+		finalize_times(context, config, times);
+		refine_times(context, config, raw, times);
+	}
+
+	// Whether a time in seconds lies within a margin of a whole minute
+	static bool near_minute_boundary(double time, double margin)
+	{
+		if (margin >= 30.0)
+			return true;
+		double seconds = time - 60.0 * ::floor(time / 60.0);
+		return seconds < margin || seconds > 60.0 - margin;
+	}
+
+	// Seconds by which the precise declination of the sun may move an
+	// iterated time, infinite if it may make the time appear or vanish.
+	// This grows where the sun barely reaches the angle of the time.
+	template <class Config>
+	double declination_shift(const Context& context, const Config& config, int time, double raw) const
+	{
+		if (time == Dhuhr || is_minutes_time(config, time))
+			return 0.0;
+
+		SolarContext solar = solar_context(context, (std::isnan(raw) ? default_times()[time] : raw) / 24.0);
+		double shift = 0.0;
+		for (int sign = -1; sign <= 1; sign += 2)
+		{
+			SolarContext moved = solar;
+			moved.declination += sign * HYBRID_DECLINATION_GAP;
+			moved.sin_declination = DMath::sin(moved.declination);
+			moved.cos_declination = DMath::cos(moved.declination);
+			double moved_time = compute_time(context, config, time, moved);
+			if (std::isnan(moved_time) != std::isnan(raw))
+				return INFINITY;
+			if (!std::isnan(raw))
+				shift = ::fmax(shift, ::fabs(moved_time - raw) * 3600.0);
+		}
+		return shift;
+	}
+
+	// Mark a time for refinement, along with the times it is derived from
+	template <class Config>
+	static void mark_refined(const Config& config, int time, bool refined[])
+	{
+		refined[time] = true;
+		if (time == Midnight)
+		{
+			mark_refined(config, Sunset, refined);
+			if (config.midnight_method() == JafariMidnight)
+			{
+				mark_refined(config, Maghrib, refined);
+				mark_refined(config, Fajr, refined);
+			}
+			else
+				mark_refined(config, Sunrise, refined);
+		}
+		else if (time == Imsak && config.imsak_is_minutes())
+			mark_refined(config, Fajr, refined);
+		else if (time == Maghrib && config.maghrib_is_minutes())
+			mark_refined(config, Sunset, refined);
+		else if (time == Isha && config.isha_is_minutes())
+			mark_refined(config, Maghrib, refined);
+		else if (config.high_latitudes_method() != None &&
+				(time == Imsak || time == Fajr || time == Maghrib || time == Isha))
+		{
+			// The night these times may be adjusted to
+			refined[Sunrise] = true;
+			refined[Sunset] = true;
+		}
+	}
+
+	// Compute again with the precise sun position the times of a day which
+	// are close to a minute boundary, along with the times they are derived
+	// from, starting from the iterated times raw, and finalize them again.
+	// The margin of each time is hybrid_margin, which covers the difference
+	// in equation of time, widened by the shift the difference in
+	// declination may cause to the times it is derived from.
+	template <class Config>
+	void refine_times(const Context& context, const Config& config, double raw[], double times[]) const
+	{
+		double shifts[TimesCount];
+		for (int i = 0; i < Midnight; ++i)
+			shifts[i] = declination_shift(context, config, i, raw[i]);
+		if (config.imsak_is_minutes())
+			shifts[Imsak] = shifts[Fajr];
+		if (config.maghrib_is_minutes())
+			shifts[Maghrib] = shifts[Sunset];
+		if (config.isha_is_minutes())
+			shifts[Isha] = shifts[Maghrib];
+		double night_shift = ::fmax(shifts[Sunrise], shifts[Sunset]);
+		if (config.high_latitudes_method() != None)
+		{
+			shifts[Imsak] = ::fmax(shifts[Imsak], night_shift);
+			shifts[Fajr] = ::fmax(shifts[Fajr], night_shift);
+			shifts[Maghrib] = ::fmax(shifts[Maghrib], night_shift);
+			shifts[Isha] = ::fmax(shifts[Isha], night_shift);
+		}
+		shifts[Midnight] = config.midnight_method() == JafariMidnight ?
+			::fmax(shifts[Sunset], ::fmax(shifts[Maghrib], shifts[Fajr])) : night_shift;
+
+		bool refined[TimesCount] = { false };
+		bool any = false;
+		for (int i = 0; i < TimesCount; ++i)
+			if (near_minute_boundary(times[i], hybrid_margin + shifts[i]))
+			{
+				mark_refined(config, i, refined);
+				any = true;
+			}
+		if (!any)
+			return;
+
+		// Iterate to convergence, from the default estimate for times the
+		// fast sun position never reaches
+		Context precise_context = context;
+		precise_context.precise = true;
+		for (int i = 0; i < Midnight; ++i)
+		{
+			if (!refined[i] || is_minutes_time(config, i))
+				continue;
+
+			int count = 0;
+			double previous;
+			if (std::isnan(raw[i]))
+				raw[i] = default_times()[i];
+			do
+			{
+				previous = raw[i];
+				raw[i] = compute_time(precise_context, config, i, solar_context(precise_context, raw[i] / 24.0));
+				++count;
+			}
+			while (count < iteration_limit() && !std::isnan(raw[i]) &&
+					::fabs(raw[i] - previous) * 3600.0 > convergence_tolerance);
+		}
 
-		if (settings.imsak_is_minutes)
-			times[Imsak] = times[Fajr] - settings.imsak / 60.0;
-		if (settings.maghrib_is_minutes)
-			times[Maghrib] = times[Sunset] + settings.maghrib / 60.0;
-		if (settings.isha_is_minutes)
-			times[Isha] = times[Maghrib] + settings.isha / 60.0;
-		times[Dhuhr] += settings.dhuhr / 60.0; 
+		for (int i = 0; i < TimesCount; ++i)
+			times[i] = raw[i];
+		finalize_times(context, config, times);
+	}
+
+	template <class Config>
+	void adjust_times(const Context& context, const Config& config, double times[]) const
+	{
+		for (int i = 0; i < TimesCount; ++i)
+			times[i] += context.timezone - context.longitude / 15.0;
+
+		if (config.high_latitudes_method() != None)
+			adjust_high_latitudes(config, times);
+
+		if (config.imsak_is_minutes())
+			times[Imsak] = times[Fajr] - config.imsak() / 60.0;
+		if (config.maghrib_is_minutes())
+			times[Maghrib] = times[Sunset] + config.maghrib() / 60.0;
+		if (config.isha_is_minutes())
+			times[Isha] = times[Maghrib] + config.isha() / 60.0;
+		times[Dhuhr] += config.dhuhr() / 60.0;
 	}
 
 	// Get Asr shadow factor
-	double asr_factor(double asr_param)
+	template <class Config>
+	static double asr_factor(const Config& config)
 	{
-		switch (settings.asr_juristics_method)
+		switch (config.asr_juristics_method())
 		{
 			case StandardAsr:
 				return 1.0;
 			case HanafiAsr:
 				return 2.0;
 			default:
-				return asr_param;
+				return config.asr();
 		}
 	}
 
-	// Return sun angle for sunset/sunrise
-	double rise_set_angle()
+	// Return sun angle for sunset/sunrise, with the exact dip of the horizon
+	// if precise is set
+	static double rise_set_angle(double elevation, bool precise = false)
 	{
-		// double earth_rad = 6371009.0;		// In meters
-		// double angle = DMath::arccos(earth_rad / (earth_rad + elevation));
-		double angle = 0.0347 * ::sqrt(elevation);		// An approximation
+		double angle;
+		if (precise)
+		{
+			double earth_rad = 6371009.0;		// In meters
+			angle = elevation > 0.0 ? DMath::arccos(earth_rad / (earth_rad + elevation)) : 0.0;
+		}
+		else
+			angle = 0.0347 * ::sqrt(elevation);		// An approximation
 		return 0.833 + angle;
 	}
 
 	// Apply offsets to the times
-	void tune_times(double times[])
+	void tune_times(double times[]) const
 	{
 		for (int i = 0; i < TimesCount; ++i)
 			times[i] += time_offsets[i] / 60.0; 
 	}
 
 	// Convert times from hours to seconds
-	void modify_formats(double times[])
+	void modify_formats(double times[]) const
 	{
 		for (int i = 0; i < TimesCount; ++i)
 			times[i] *= 3600.0;
 	}
 
 	// adjust times for locations in higher latitudes
-	void adjust_high_latitudes(double times[])
+	template <class Config>
+	void adjust_high_latitudes(const Config& config, double times[]) const
 	{
-		double night_time = time_diff(times[Sunset], times[Sunrise]); 
+		double night_time = time_diff(times[Sunset], times[Sunrise]);
 
-		times[Imsak]   = adjust_high_latitude_time(times[Imsak],   times[Sunrise], settings.imsak,   night_time, true);
-		times[Fajr]    = adjust_high_latitude_time(times[Fajr],    times[Sunrise], settings.fajr,    night_time, true);
-		times[Isha]    = adjust_high_latitude_time(times[Isha],    times[Sunset],  settings.isha,    night_time);
-		times[Maghrib] = adjust_high_latitude_time(times[Maghrib], times[Sunset],  settings.maghrib, night_time);
+		times[Imsak]   = adjust_high_latitude_time(config, times[Imsak],   times[Sunrise], config.imsak(),   night_time, true);
+		times[Fajr]    = adjust_high_latitude_time(config, times[Fajr],    times[Sunrise], config.fajr(),    night_time, true);
+		times[Isha]    = adjust_high_latitude_time(config, times[Isha],    times[Sunset],  config.isha(),    night_time);
+		times[Maghrib] = adjust_high_latitude_time(config, times[Maghrib], times[Sunset],  config.maghrib(), night_time);
 	}
 
 	// adjust a time for higher latitudes
-	double adjust_high_latitude_time(double time, double base, double angle, double night, bool direction_is_ccw = false)
+	template <class Config>
+	double adjust_high_latitude_time(const Config& config, double time, double base, double angle, double night,
+			bool direction_is_ccw = false) const
 	{
-		double portion = night_portion(angle, night);
+		double portion = night_portion(config, angle, night);
 		double time_diff_value = direction_is_ccw ? time_diff(time, base) : time_diff(base, time);
-		if (time_diff_value > portion) 
+		if (time_diff_value > portion)
 			time = base + (direction_is_ccw ? -portion : portion);
 		return time;
 	}
 
 	// the night portion used for adjusting times in higher latitudes
-	double night_portion(double angle, double night)
+	template <class Config>
+	static double night_portion(const Config& config, double angle, double night)
 	{
 		double portion = 0.5;		// Midnight
-		if (settings.high_latitudes_method == AngleBased)
+		if (config.high_latitudes_method() == AngleBased)
 			portion = angle / 60.0;
-		else if (settings.high_latitudes_method == OneSeventh)
+		else if (config.high_latitudes_method() == OneSeventh)
 			portion = 1.0 / 7.0;
 		return portion * night;
 	}
 
 	// Convert hours to day portions 
-	void day_portion(double times[])
+	void day_portion(double times[]) const
 	{
 		for (int i = 0; i < TimesCount; ++i)
 			times[i] /= 24.0;
@@ -538,7 +1857,7 @@ protected:
 	//---------------------- Misc Functions -----------------------
 
 	// Compute the difference between two times 
-	double time_diff(double time1, double time2)
+	double time_diff(double time1, double time2) const
 	{
 		return DMath::fix_hour(time2 - time1);
 	}
@@ -554,18 +1873,349 @@ protected:
 
 	CalculationMethod calc_method;
 	double time_offsets[TimesCount];
+	const SolarEphemeris* ephemeris;
+	const TimeZoneResolver* timezone_resolver;
+	const ElevationResolver* elevation_resolver;
+	bool fast_trig;
+	double convergence_tolerance;		// In seconds
+	int max_iterations;
+	Precision precision;
+	double hybrid_margin;		// In seconds
 
-	// Temporary shared variables
+/* --------------------- Technical Settings -------------------- */
 
-	double latitude;
-	double longitude;
-	double elevation;
-	double timezone;
-	double julian_date;
+	static const int NUM_ITERATIONS = 1;		// Default maximum number of iterations to compute times
+	static const int BATCH_WIDTH = 8;		// Number of locations computed side by side in batch mode
+	static const int TZ_PROBE_DAYS = 14;		// Days between two timezone lookups in range mode
+	static const int HYBRID_ITERATIONS = 20;		// Minimum maximum number of iterations in HybridPrecision
+	static const int HYBRID_REFINED_POSITIONS = 3;		// Precise sun positions HybridPrecision computes a day
+	// Largest difference between the fast and precise declinations of the
+	// sun over years 1900-2100, in degrees
+	static constexpr double HYBRID_DECLINATION_GAP = 0.0062;
+
+	// Parameters of the predefined methods, copied to method_params
+	static const MethodConfig* default_method_params()
+	{
+		static const MethodConfig params[CalculationMethodsCount] = {
+			method_config(MWL), method_config(ISNA), method_config(Egypt), method_config(Makkah),
+			method_config(Karachi), method_config(Jafari), method_config(Tehran), method_config(Custom),
+		};
+		return params;
+	}
 
-/* --------------------- Technical Settings -------------------- */
+	// Initial guess of times used for the first iteration, Midnight is computed afterwards
+	static const double* default_times()
+	{
+		static const double times[TimesCount] = { 5, 5, 6, 12, 13, 18, 18, 18, 0 };
+		return times;
+	}
 
-	static const int NUM_ITERATIONS = 1;		// Number of iterations needed to compute times
+	//-------------------------- Batch Compute ---------------------------
+
+	// The batch functions mirror the scalar ones above, but operate on a
+	// block of up to BATCH_WIDTH locations stored as a structure of arrays.
+	// Every step is a plain loop over the lanes of the block without any
+	// member state, so the compiler is free to vectorize it.
+
+	struct BatchBlock
+	{
+		const SolarEphemeris* ephemeris;
+		bool precise;
+		double latitude[BATCH_WIDTH];
+		double sin_latitude[BATCH_WIDTH];
+		double cos_latitude[BATCH_WIDTH];
+		double longitude[BATCH_WIDTH];
+		double elevation[BATCH_WIDTH];
+		double timezone[BATCH_WIDTH];
+		double julian_date[BATCH_WIDTH];
+		double times[TimesCount][BATCH_WIDTH];
+	};
+
+	// Degree-based trigonometry over the lanes of a block, with DMathSimd
+	// when fast_trig is set, else with libm through DMath
+	void batch_sin(const double d[], double out[], int n) const
+	{
+		if (fast_trig)
+			DMathSimd::sin(d, out, n);
+		else
+			for (int k = 0; k < n; ++k)
+				out[k] = DMath::sin(d[k]);
+	}
+
+	void batch_sincos(const double d[], double s[], double c[], int n) const
+	{
+		if (fast_trig)
+			DMathSimd::sincos(d, s, c, n);
+		else
+			for (int k = 0; k < n; ++k)
+			{
+				s[k] = DMath::sin(d[k]);
+				c[k] = DMath::cos(d[k]);
+			}
+	}
+
+	void batch_tan(const double d[], double out[], int n) const
+	{
+		if (fast_trig)
+			DMathSimd::tan(d, out, n);
+		else
+			for (int k = 0; k < n; ++k)
+				out[k] = DMath::tan(d[k]);
+	}
+
+	void batch_arccos(const double x[], double out[], int n) const
+	{
+		if (fast_trig)
+			DMathSimd::arccos(x, out, n);
+		else
+			for (int k = 0; k < n; ++k)
+				out[k] = DMath::arccos(x[k]);
+	}
+
+	void batch_arccot(const double x[], double out[], int n) const
+	{
+		if (fast_trig)
+			DMathSimd::arccot(x, out, n);
+		else
+			for (int k = 0; k < n; ++k)
+				out[k] = DMath::arccot(x[k]);
+	}
+
+	// Compute declination angle of sun and equation of time for each lane
+	// Lanes share the ephemeris table of the block, which interpolates all
+	// of them at once when it covers their dates, as it does for the days
+	// it was built for.
+	void batch_sun_position(const BatchBlock& b, int n, const double time[],
+			double equation[], double declination[]) const
+	{
+		double jd[BATCH_WIDTH];
+		bool contained = b.ephemeris && b.ephemeris->is_precise() == b.precise;
+		for (int k = 0; k < n; ++k)
+		{
+			jd[k] = b.julian_date[k] + time[k];
+			contained = contained && b.ephemeris->contains(jd[k]);
+		}
+		if (contained)
+		{
+			b.ephemeris->sun_positions(jd, n, equation, declination);
+			return;
+		}
+
+		for (int k = 0; k < n; ++k)
+		{
+			std::pair<double, double> position = sun_position(b.ephemeris, b.julian_date[k] + time[k], b.precise);
+			equation[k] = position.first;
+			declination[k] = position.second;
+		}
+	}
+
+	// Compute the time at which sun reaches a specific angle below horizon,
+	// given the sun position at the estimated time
+	void batch_hour_angle_time(const BatchBlock& b, int n, const double angle[],
+			const double equation[], const double declination[], double time[],
+			bool direction_is_ccw) const
+	{
+		double sin_angle[BATCH_WIDTH] = {}, sin_declination[BATCH_WIDTH] = {}, cos_declination[BATCH_WIDTH] = {};
+		double t[BATCH_WIDTH] = {};
+		batch_sin(angle, sin_angle, n);
+		batch_sincos(declination, sin_declination, cos_declination, n);
+		for (int k = 0; k < n; ++k)
+			t[k] = (-sin_angle[k] - sin_declination[k] * b.sin_latitude[k]) /
+				(cos_declination[k] * b.cos_latitude[k]);
+		batch_arccos(t, t, n);
+
+		for (int k = 0; k < n; ++k)
+		{
+			double noon = DMath::fix_hour(12.0 - equation[k]);
+			time[k] = noon + (direction_is_ccw ? -t[k] : t[k]) / 15.0;
+		}
+	}
+
+	void batch_sun_angle_time(const BatchBlock& b, int n, const double angle[], double time[],
+			bool direction_is_ccw = false) const
+	{
+		double equation[BATCH_WIDTH] = {}, declination[BATCH_WIDTH] = {};
+		batch_sun_position(b, n, time, equation, declination);
+		batch_hour_angle_time(b, n, angle, equation, declination, time, direction_is_ccw);
+	}
+
+	void batch_sun_angle_time(const BatchBlock& b, int n, double angle, double time[],
+			bool direction_is_ccw = false) const
+	{
+		double angles[BATCH_WIDTH] = {};
+		for (int k = 0; k < n; ++k)
+			angles[k] = angle;
+		batch_sun_angle_time(b, n, angles, time, direction_is_ccw);
+	}
+
+	void batch_mid_day(const BatchBlock& b, int n, double time[]) const
+	{
+		double equation[BATCH_WIDTH] = {}, declination[BATCH_WIDTH] = {};
+		batch_sun_position(b, n, time, equation, declination);
+		for (int k = 0; k < n; ++k)
+			time[k] = DMath::fix_hour(12.0 - equation[k]);
+	}
+
+	void batch_asr_time(const BatchBlock& b, int n, double factor, double time[]) const
+	{
+		double equation[BATCH_WIDTH] = {}, declination[BATCH_WIDTH] = {}, angle[BATCH_WIDTH] = {};
+		batch_sun_position(b, n, time, equation, declination);
+		for (int k = 0; k < n; ++k)
+			angle[k] = ::fabs(b.latitude[k] - declination[k]);
+		batch_tan(angle, angle, n);
+		for (int k = 0; k < n; ++k)
+			angle[k] += factor;
+		batch_arccot(angle, angle, n);
+		for (int k = 0; k < n; ++k)
+			angle[k] = -angle[k];
+		batch_hour_angle_time(b, n, angle, equation, declination, time, false);
+	}
+
+	void batch_compute_prayer_times(BatchBlock& b, int n) const
+	{
+		for (int i = 0; i < TimesCount; ++i)
+			for (int k = 0; k < n; ++k)
+				b.times[i][k] /= 24.0;
+
+		double rise_set[BATCH_WIDTH] = {};
+		for (int k = 0; k < n; ++k)
+			rise_set[k] = rise_set_angle(b.elevation[k], precision != FastPrecision);
+
+		// Times given in minutes are only estimated, batch_adjust_times()
+		// sets them
+		if (!settings.imsak_is_minutes)
+			batch_sun_angle_time(b, n, settings.imsak, b.times[Imsak], true);
+		batch_sun_angle_time(b, n, settings.fajr, b.times[Fajr], true);
+		batch_sun_angle_time(b, n, rise_set, b.times[Sunrise], true);
+		batch_mid_day(b, n, b.times[Dhuhr]);
+		batch_asr_time(b, n, asr_factor(RuntimeSettings(settings)), b.times[Asr]);
+		batch_sun_angle_time(b, n, rise_set, b.times[Sunset]);
+		if (!settings.maghrib_is_minutes)
+			batch_sun_angle_time(b, n, settings.maghrib, b.times[Maghrib]);
+		if (!settings.isha_is_minutes)
+			batch_sun_angle_time(b, n, settings.isha, b.times[Isha]);
+
+		for (int k = 0; k < n; ++k)
+		{
+			if (settings.imsak_is_minutes)
+				b.times[Imsak][k] = b.times[Fajr][k];
+			if (settings.maghrib_is_minutes)
+				b.times[Maghrib][k] = b.times[Sunset][k];
+			if (settings.isha_is_minutes)
+				b.times[Isha][k] = b.times[Maghrib][k];
+		}
+	}
+
+	void batch_adjust_times(BatchBlock& b, int n) const
+	{
+		for (int i = 0; i < TimesCount; ++i)
+			for (int k = 0; k < n; ++k)
+				b.times[i][k] += b.timezone[k] - b.longitude[k] / 15.0;
+
+		const RuntimeSettings config(settings);
+		if (settings.high_latitudes_method != None)
+			for (int k = 0; k < n; ++k)
+			{
+				double night_time = time_diff(b.times[Sunset][k], b.times[Sunrise][k]);
+				b.times[Imsak][k]   = adjust_high_latitude_time(config, b.times[Imsak][k],   b.times[Sunrise][k], settings.imsak,   night_time, true);
+				b.times[Fajr][k]    = adjust_high_latitude_time(config, b.times[Fajr][k],    b.times[Sunrise][k], settings.fajr,    night_time, true);
+				b.times[Isha][k]    = adjust_high_latitude_time(config, b.times[Isha][k],    b.times[Sunset][k],  settings.isha,    night_time);
+				b.times[Maghrib][k] = adjust_high_latitude_time(config, b.times[Maghrib][k], b.times[Sunset][k],  settings.maghrib, night_time);
+			}
+
+		for (int k = 0; k < n; ++k)
+		{
+			if (settings.imsak_is_minutes)
+				b.times[Imsak][k] = b.times[Fajr][k] - settings.imsak / 60.0;
+			if (settings.maghrib_is_minutes)
+				b.times[Maghrib][k] = b.times[Sunset][k] + settings.maghrib / 60.0;
+			if (settings.isha_is_minutes)
+				b.times[Isha][k] = b.times[Maghrib][k] + settings.isha / 60.0;
+			b.times[Dhuhr][k] += settings.dhuhr / 60.0;
+		}
+	}
+
+	// Whether no time of any lane moved by more than convergence_tolerance
+	// from its previous value, in hours, leaving out times given in minutes
+	bool batch_converged(const BatchBlock& b, int n, const double previous[][BATCH_WIDTH]) const
+	{
+		const RuntimeSettings config(settings);
+		for (int j = 0; j < Midnight; ++j)
+			for (int k = 0; k < n && !is_minutes_time(config, j); ++k)
+				if (::fabs(b.times[j][k] - previous[j][k]) * 3600.0 > convergence_tolerance)
+					return false;
+		return true;
+	}
+
+	void batch_compute_times(BatchBlock& b, int n) const
+	{
+		batch_sincos(b.latitude, b.sin_latitude, b.cos_latitude, n);
+
+		for (int i = 0; i < TimesCount; ++i)
+			for (int k = 0; k < n; ++k)
+				b.times[i][k] = default_times()[i];
+
+		// Iterate until every time of every lane settled
+		for (int i = 1; ; ++i)
+		{
+			double previous[TimesCount][BATCH_WIDTH];
+			for (int j = 0; j < TimesCount; ++j)
+				for (int k = 0; k < n; ++k)
+					previous[j][k] = b.times[j][k];
+
+			batch_compute_prayer_times(b, n);
+			if (i >= iteration_limit() || batch_converged(b, n, previous))
+				break;
+		}
+
+		double raw[TimesCount][BATCH_WIDTH];
+		if (precision == HybridPrecision && !b.precise)
+			for (int j = 0; j < TimesCount; ++j)
+				for (int k = 0; k < n; ++k)
+					raw[j][k] = b.times[j][k];
+
+		batch_adjust_times(b, n);
+
+		for (int k = 0; k < n; ++k)
+		{
+			if (settings.midnight_method == JafariMidnight)
+				b.times[Midnight][k] = b.times[Sunset][k] + time_diff(b.times[Maghrib][k], b.times[Fajr][k]) / 2.0;
+			else
+				b.times[Midnight][k] = b.times[Sunset][k] + time_diff(b.times[Sunset][k], b.times[Sunrise][k]) / 2.0;
+		}
+
+		for (int i = 0; i < TimesCount; ++i)
+			for (int k = 0; k < n; ++k)
+				b.times[i][k] = (b.times[i][k] + time_offsets[i] / 60.0) * 3600.0;
+
+		if (precision == HybridPrecision && !b.precise)
+			batch_refine_times(b, n, raw);
+	}
+
+	// Refine the times of each lane close to a minute boundary with the
+	// scalar functions
+	void batch_refine_times(BatchBlock& b, int n, const double raw[][BATCH_WIDTH]) const
+	{
+		const RuntimeSettings config(settings);
+		for (int k = 0; k < n; ++k)
+		{
+			Location location = { b.latitude[k], b.longitude[k], b.elevation[k], b.timezone[k] };
+			Context context = make_context(location, 0.0, false, b.ephemeris);
+			context.julian_date = b.julian_date[k];
+
+			double lane_raw[TimesCount], lane_times[TimesCount];
+			for (int j = 0; j < TimesCount; ++j)
+			{
+				lane_raw[j] = raw[j][k];
+				lane_times[j] = b.times[j][k];
+			}
+			refine_times(context, config, lane_raw, lane_times);
+			for (int j = 0; j < TimesCount; ++j)
+				b.times[j][k] = lane_times[j];
+		}
+	}
 };
 
 }
+
+#endif /* PRAYERTIMES_HPP */
@@ -0,0 +1,247 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Current and next prayer times at a given instant
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_SCHEDULE_HPP
+#define PRAYERTIMES_SCHEDULE_HPP
+
+#include <cmath>
+#include <ctime>
+#include <stdint.h>
+
+#include "prayertimes.hpp"
+#include "tzfile.hpp"
+
+namespace prayertimes
+{
+
+// Prayer time at an absolute instant
+struct Event
+{
+	int time;		// One of Times, or -1 if there is none
+	int64_t instant;		// UTC seconds since the epoch
+};
+
+// Answers which prayer time is the current one and which comes next at a
+// given instant, with the instants of both, for a single location. Times
+// of the days around the last queried instant are kept, so repeated
+// queries during a day don't compute anything.
+//
+// A schedule keeps its own state and isn't meant to be shared between
+// threads. Its prayer times must outlive it, and clear() must be called
+// after changing their settings.
+class Schedule
+{
+public:
+	// Times considered by default, the ones shown by most applications
+	static const unsigned PRAYER_EVENTS = (1 << Fajr) | (1 << Sunrise) | (1 << Dhuhr) |
+		(1 << Asr) | (1 << Maghrib) | (1 << Isha);
+
+	// The timezone of a location given without one is taken from zone if
+	// not NULL, else from the timezone resolver of prayer_times, else from
+	// the local timezone. events is a mask of the times to consider, 1 << t
+	// for each time t.
+	Schedule(const PrayerTimes& prayer_times, const Location& location, const TimeZone* zone = NULL,
+			unsigned events = PRAYER_EVENTS) :
+		prayer_times(prayer_times), location(location), zone(zone), events(events)
+	{
+		clear();
+	}
+
+	const Location& get_location() const
+	{
+		return location;
+	}
+
+	void set_location(const Location& new_location)
+	{
+		location = new_location;
+		clear();
+	}
+
+	void set_timezone(const TimeZone* new_zone)
+	{
+		zone = new_zone;
+		clear();
+	}
+
+	unsigned get_events() const
+	{
+		return events;
+	}
+
+	void set_events(unsigned new_events)
+	{
+		events = new_events;
+		clear();
+	}
+
+	// Forget the times computed so far
+	void clear()
+	{
+		for (int i = 0; i < CACHED_DAYS; ++i)
+			cache[i].valid = false;
+		last_used = 0;
+	}
+
+	// Find the last event at or before now, and the first one after it
+	// Events not found, as when the sun doesn't set at high latitudes, have
+	// a time of -1. Returns whether both were found.
+	bool get_events(int64_t now, Event& current, Event& next)
+	{
+		current.time = next.time = -1;
+		current.instant = next.instant = 0;
+
+		int64_t today = local_day(now);
+		const Day& day = get_day(today);
+		find_events(day, now, current, next);
+
+		// Before the first event of the day, the current one is from the day
+		// before, and so may be the next one when times pass midnight
+		if (current.time < 0)
+			find_events(get_day(today - 1), now, current, next);
+		// After the last one, the next event is from the day after
+		else if (next.time < 0)
+			find_events(get_day(today + 1), now, current, next);
+		return current.time >= 0 && next.time >= 0;
+	}
+
+	Event get_current_event(int64_t now)
+	{
+		Event current, next;
+		get_events(now, current, next);
+		return current;
+	}
+
+	Event get_next_event(int64_t now)
+	{
+		Event current, next;
+		get_events(now, current, next);
+		return next;
+	}
+
+	// Seconds from now until the next event, or -1 if there is none
+	int64_t get_countdown(int64_t now)
+	{
+		Event next = get_next_event(now);
+		return next.time < 0 ? -1 : next.instant - now;
+	}
+
+private:
+	static const int CACHED_DAYS = 2;
+
+	// Instants of the times of a local day
+	struct Day
+	{
+		bool valid;
+		int64_t day;		// Days since the epoch
+		double instants[TimesCount];		// NAN for times not considered or not found
+	};
+
+	static int64_t floor_div(int64_t a, int64_t b)
+	{
+		return a / b - (a % b != 0 && (a < 0) != (b < 0));
+	}
+
+	// Timezone in hours of a location at a UTC instant
+	double timezone_at(int64_t utc) const
+	{
+		if (!std::isnan(location.timezone))
+			return location.timezone;
+		if (zone)
+			return zone->get_offset(utc) / 3600.0;
+		const TimeZoneResolver* resolver = prayer_times.get_timezone_resolver();
+		if (!resolver)
+			return PrayerTimes::get_timezone((time_t) utc);
+		int year, month, day;
+		PrayerTimes::gregorian(EPOCH_JULIAN + floor_div(utc, 86400), year, month, day);
+		return resolver->get_timezone(location.latitude, location.longitude, year, month, day);
+	}
+
+	int64_t local_day(int64_t utc) const
+	{
+		return floor_div(utc + (int64_t) ::floor(timezone_at(utc) * 3600.0 + 0.5), 86400);
+	}
+
+	// Get the times of a local day, computing them if they aren't cached
+	const Day& get_day(int64_t day)
+	{
+		for (int i = 0; i < CACHED_DAYS; ++i)
+			if (cache[i].valid && cache[i].day == day)
+			{
+				last_used = i;
+				return cache[i];
+			}
+
+		// Replace the day not used last
+		last_used = (last_used + 1) % CACHED_DAYS;
+		Day& entry = cache[last_used];
+		entry.valid = true;
+		entry.day = day;
+
+		int year, month, date;
+		PrayerTimes::gregorian(EPOCH_JULIAN + day, year, month, date);
+		Location day_location = location;
+		day_location.timezone = day_timezone(year, month, date);
+
+		double times[TimesCount];
+		prayer_times.get_prayer_times(year, month, date, day_location, times);
+		for (int t = 0; t < TimesCount; ++t)
+			entry.instants[t] = (events & (1 << t)) && !std::isnan(times[t]) ?
+				day * 86400.0 + times[t] - day_location.timezone * 3600.0 : NAN;
+		return entry;
+	}
+
+	// Timezone in hours the times of a local day are computed in
+	double day_timezone(int year, int month, int day) const
+	{
+		if (!std::isnan(location.timezone))
+			return location.timezone;
+		if (zone)
+			return zone->get_timezone(year, month, day);
+		const TimeZoneResolver* resolver = prayer_times.get_timezone_resolver();
+		if (resolver)
+			return resolver->get_timezone(location.latitude, location.longitude, year, month, day);
+		return PrayerTimes::get_timezone(year, month, day);
+	}
+
+	// Update current and next with the events of a day around now
+	static void find_events(const Day& day, int64_t now, Event& current, Event& next)
+	{
+		for (int t = 0; t < TimesCount; ++t)
+		{
+			if (std::isnan(day.instants[t]))
+				continue;
+			int64_t instant = (int64_t) ::floor(day.instants[t] + 0.5);
+			if (instant <= now && (current.time < 0 || instant > current.instant))
+			{
+				current.time = t;
+				current.instant = instant;
+			}
+			else if (instant > now && (next.time < 0 || instant < next.instant))
+			{
+				next.time = t;
+				next.instant = instant;
+			}
+		}
+	}
+
+	static constexpr double EPOCH_JULIAN = 2440587.5;		// Julian day of January 1st, 1970
+
+	const PrayerTimes& prayer_times;
+	Location location;
+	const TimeZone* zone;
+	unsigned events;
+
+	Day cache[CACHED_DAYS];
+	int last_used;		// Index in cache of the day used last
+};
+
+}
+
+#endif /* PRAYERTIMES_SCHEDULE_HPP */
@@ -0,0 +1,321 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Precomputed timetable files
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_TIMETABLE_HPP
+#define PRAYERTIMES_TIMETABLE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "prayertimes.hpp"
+
+namespace prayertimes
+{
+
+/* ----------------------- File Format ----------------------- */
+
+// A timetable file holds the times of a fixed set of locations over a range
+// of days. It is made of a header, the list of locations and then, for each
+// location, its block bases followed by its days:
+//
+//   TimetableHeader
+//   TimetableLocation[location_count]
+//   for each location:
+//     int32_t bases[block_count][TimesCount]     // Seconds, or minutes
+//     delta_t deltas[day_count][TimesCount]      // From the base of the block
+//
+// Days are grouped in blocks of TIMETABLE_BLOCK_DAYS days, and each time is
+// stored as its difference to the earliest value of that time within the
+// block. With minutes encoding deltas are uint8_t, else uint16_t seconds;
+// their largest value marks a missing time. Each location takes a multiple
+// of 8 bytes. Values are in host byte order, checked by byte_order.
+
+enum TimetableEncoding
+{
+	TimetableSeconds,     // uint16_t deltas in seconds
+	TimetableMinutes,     // uint8_t deltas in minutes
+};
+
+enum
+{
+	TIMETABLE_VERSION = 1,
+	TIMETABLE_BLOCK_DAYS = 32,
+	TIMETABLE_BYTE_ORDER = 0x01020304,
+};
+
+struct TimetableHeader
+{
+	char magic[8];			// "PRTABLE\0"
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t encoding;
+	uint32_t block_days;
+	uint32_t location_count;
+	uint32_t day_count;
+	int32_t start_year;
+	int32_t start_month;
+	int32_t start_day;
+	uint32_t reserved;
+	uint64_t locations_offset;
+	uint64_t data_offset;
+	uint64_t location_size;		// Bytes of bases and deltas per location
+};
+
+struct TimetableLocation
+{
+	double latitude;
+	double longitude;
+	double elevation;
+	double timezone;
+};
+
+//------------------------- Timetable Reader --------------------------
+
+// Read-only view of a memory-mapped timetable file. Lookups only index
+// into the mapping, they neither parse nor allocate, and may be done from
+// any number of threads.
+class Timetable
+{
+public:
+	Timetable() : map(NULL), map_size(0), header(NULL)
+	{
+	}
+
+	~Timetable()
+	{
+		close();
+	}
+
+	// Map a timetable file, returning false if it can't be used
+	bool open(const char* path)
+	{
+		close();
+
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(TimetableHeader))
+		{
+			::close(fd);
+			return false;
+		}
+		void* address = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (address == MAP_FAILED)
+			return false;
+
+		map = static_cast<const char*>(address);
+		map_size = st.st_size;
+		header = reinterpret_cast<const TimetableHeader*>(map);
+		if (!valid())
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		if (map)
+			munmap(const_cast<char*>(map), map_size);
+		map = NULL;
+		map_size = 0;
+		header = NULL;
+	}
+
+	bool is_open() const
+	{
+		return header != NULL;
+	}
+
+	size_t location_count() const
+	{
+		return header->location_count;
+	}
+
+	int day_count() const
+	{
+		return header->day_count;
+	}
+
+	// Get the first day of the timetable
+	void get_start_date(int& year, int& month, int& day) const
+	{
+		year = header->start_year;
+		month = header->start_month;
+		day = header->start_day;
+	}
+
+	// Bytes of bases and deltas stored for each location
+	static uint64_t location_data_size(TimetableEncoding encoding, uint32_t days, uint32_t block_days)
+	{
+		uint64_t blocks = (days + block_days - 1) / block_days;
+		uint64_t size = blocks * TimesCount * sizeof(int32_t) +
+			(uint64_t) days * TimesCount * (encoding == TimetableMinutes ? 1 : 2);
+		return (size + 7) & ~(uint64_t) 7;
+	}
+
+	const TimetableLocation& location(size_t index) const
+	{
+		return reinterpret_cast<const TimetableLocation*>(map + header->locations_offset)[index];
+	}
+
+	// Get the times of a location on a day, counted from the start date, in
+	// seconds as returned by PrayerTimes. Missing times are NAN.
+	void get_times(size_t location_index, int day, double times[]) const
+	{
+		const char* data = map + header->data_offset + location_index * header->location_size;
+		const int32_t* base = reinterpret_cast<const int32_t*>(data) + (day / header->block_days) * TimesCount;
+		const char* deltas = data + block_count() * TimesCount * sizeof(int32_t);
+
+		if (header->encoding == TimetableMinutes)
+		{
+			const uint8_t* delta = reinterpret_cast<const uint8_t*>(deltas) + day * TimesCount;
+			for (int i = 0; i < TimesCount; ++i)
+				times[i] = delta[i] == UINT8_MAX ? NAN : (base[i] + delta[i]) * 60.0;
+		}
+		else
+		{
+			const uint16_t* delta = reinterpret_cast<const uint16_t*>(deltas) + day * TimesCount;
+			for (int i = 0; i < TimesCount; ++i)
+				times[i] = delta[i] == UINT16_MAX ? NAN : (double) (base[i] + delta[i]);
+		}
+	}
+
+private:
+	Timetable(const Timetable&);
+	Timetable& operator=(const Timetable&);
+
+	size_t block_count() const
+	{
+		return (header->day_count + header->block_days - 1) / header->block_days;
+	}
+
+	// Check the header and that the data it describes fits in the file
+	bool valid() const
+	{
+		if (memcmp(header->magic, "PRTABLE", 8) != 0 || header->version != TIMETABLE_VERSION ||
+				header->byte_order != TIMETABLE_BYTE_ORDER || header->block_days == 0 ||
+				(header->encoding != TimetableSeconds && header->encoding != TimetableMinutes))
+			return false;
+		uint64_t location_size = location_data_size((TimetableEncoding) header->encoding,
+				header->day_count, header->block_days);
+		return header->location_size == location_size &&
+			header->locations_offset + (uint64_t) header->location_count * sizeof(TimetableLocation) <= map_size &&
+			header->data_offset + header->location_count * location_size <= map_size;
+	}
+
+	const char* map;
+	size_t map_size;
+	const TimetableHeader* header;
+};
+
+//------------------------- Timetable Writer --------------------------
+
+// Compute the times of some locations over a range of days and write them
+// as a timetable file. Returns false on I/O errors, or if a time moves too
+// much within a block to be encoded, which may happen with minutes encoding
+// at high latitudes.
+inline bool write_timetable(const char* path, const PrayerTimes& prayer_times,
+		int year, int month, int day, int days,
+		const TimetableLocation locations[], size_t count,
+		TimetableEncoding encoding = TimetableMinutes)
+{
+	TimetableHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "PRTABLE", 8);
+	header.version = TIMETABLE_VERSION;
+	header.byte_order = TIMETABLE_BYTE_ORDER;
+	header.encoding = encoding;
+	header.block_days = TIMETABLE_BLOCK_DAYS;
+	header.location_count = count;
+	header.day_count = days;
+	header.start_year = year;
+	header.start_month = month;
+	header.start_day = day;
+	header.locations_offset = sizeof(header);
+	header.data_offset = (sizeof(header) + count * sizeof(TimetableLocation) + 7) & ~(size_t) 7;
+	header.location_size = Timetable::location_data_size(encoding, days, TIMETABLE_BLOCK_DAYS);
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(locations, sizeof(TimetableLocation), count, file) == count;
+	for (size_t i = sizeof(header) + count * sizeof(TimetableLocation); ok && i < header.data_offset; ++i)
+		ok = putc(0, file) != EOF;
+
+	int unit = encoding == TimetableMinutes ? 60 : 1;
+	long missing = encoding == TimetableMinutes ? UINT8_MAX : UINT16_MAX;
+	int blocks = (days + TIMETABLE_BLOCK_DAYS - 1) / TIMETABLE_BLOCK_DAYS;
+	std::vector<double> times(days * TimesCount);
+	std::vector<int32_t> bases(blocks * TimesCount);
+	std::vector<char> data(header.location_size);
+
+	for (size_t l = 0; ok && l < count; ++l)
+	{
+		const TimetableLocation& location = locations[l];
+		prayer_times.get_prayer_times_range(year, month, day, days,
+				location.latitude, location.longitude, location.elevation, location.timezone, &times[0]);
+
+		// Base of each time in each block is its earliest value
+		for (int b = 0; b < blocks; ++b)
+			for (int i = 0; i < TimesCount; ++i)
+			{
+				double base = INFINITY;
+				for (int d = b * TIMETABLE_BLOCK_DAYS; d < days && d < (b + 1) * TIMETABLE_BLOCK_DAYS; ++d)
+					if (!std::isnan(times[d * TimesCount + i]))
+						base = std::min(base, ::floor(times[d * TimesCount + i] / unit + 0.5));
+				bases[b * TimesCount + i] = std::isinf(base) ? 0 : (int32_t) base;
+			}
+
+		std::fill(data.begin(), data.end(), 0);
+		memcpy(&data[0], &bases[0], bases.size() * sizeof(int32_t));
+		char* deltas = &data[bases.size() * sizeof(int32_t)];
+		for (int d = 0; ok && d < days; ++d)
+			for (int i = 0; i < TimesCount; ++i)
+			{
+				double time = times[d * TimesCount + i];
+				long delta = std::isnan(time) ? missing :
+					(long) ::floor(time / unit + 0.5) - bases[(d / TIMETABLE_BLOCK_DAYS) * TimesCount + i];
+				if (delta < 0 || delta > missing || (delta == missing && !std::isnan(time)))
+				{
+					ok = false;
+					break;
+				}
+				if (encoding == TimetableMinutes)
+					reinterpret_cast<uint8_t*>(deltas)[d * TimesCount + i] = delta;
+				else
+					reinterpret_cast<uint16_t*>(deltas)[d * TimesCount + i] = delta;
+			}
+
+		ok = ok && fwrite(&data[0], 1, data.size(), file) == data.size();
+	}
+
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok)
+		remove(path);
+	return ok;
+}
+
+}
+
+#endif /* PRAYERTIMES_TIMETABLE_HPP */
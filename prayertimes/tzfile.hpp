@@ -0,0 +1,496 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Timezones from TZif (zoneinfo) files
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_TZFILE_HPP
+#define PRAYERTIMES_TZFILE_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <stdint.h>
+
+namespace prayertimes
+{
+
+// Default directory of zoneinfo files
+static const char* const TZ_DIRECTORY = "/usr/share/zoneinfo";
+
+//------------------------- Timezone -------------------------
+
+// UTC offsets of an IANA timezone, loaded from a TZif file as described in
+// RFC 8536. Transitions are kept sorted in memory and offsets are found by
+// binary search; instants after the last transition follow the POSIX TZ
+// rule found at the end of version 2 and later files. Lookups don't touch
+// the TZ environment variable or any libc state, and a loaded timezone is
+// never modified, so it may be used by any number of threads.
+class TimeZone
+{
+public:
+	TimeZone()
+	{
+	}
+
+	// Load a timezone by name, such as "Europe/Paris", from a zoneinfo
+	// directory, or from a file if name is an absolute path. Returns false
+	// if the file can't be read or isn't a valid TZif file.
+	bool load(const std::string& name, const char* directory = TZ_DIRECTORY)
+	{
+		clear();
+		if (name.empty() || name.find("..") != std::string::npos)
+			return false;
+
+		std::string path = name[0] == '/' ? name : std::string(directory) + "/" + name;
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		std::vector<unsigned char> data;
+		unsigned char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			data.insert(data.end(), buffer, buffer + n);
+		bool ok = !ferror(file);
+		fclose(file);
+
+		if (!ok || data.empty() || !parse(&data[0], data.size()))
+			return false;
+		zone_name = name;
+		return true;
+	}
+
+	// Parse the contents of a TZif file, returning false if it isn't valid
+	bool parse(const unsigned char* data, size_t size)
+	{
+		clear();
+
+		TzifHeader header;
+		if (!read_header(data, size, header))
+			return false;
+
+		// Version 2 and later files repeat the data with 64-bit times,
+		// followed by a POSIX TZ string
+		const unsigned char* block = data + TZIF_HEADER_SIZE;
+		int time_size = 4;
+		if (header.version >= '2')
+		{
+			size_t skip = TZIF_HEADER_SIZE + block_size(header, 4);
+			if (skip > size || !read_header(data + skip, size - skip, header))
+				return false;
+			block = data + skip + TZIF_HEADER_SIZE;
+			time_size = 8;
+		}
+		size_t length = block_size(header, time_size);
+		if ((size_t) (block - data) + length > size || header.type_count == 0)
+			return false;
+
+		const unsigned char* p = block;
+		transitions.resize(header.time_count);
+		for (uint32_t i = 0; i < header.time_count; ++i, p += time_size)
+			transitions[i] = read_integer(p, time_size);
+		type_indices.assign(p, p + header.time_count);
+		p += header.time_count;
+
+		offsets.resize(header.type_count);
+		for (uint32_t i = 0; i < header.type_count; ++i, p += 6)
+			offsets[i] = (int32_t) read_integer(p, 4);
+
+		for (uint32_t i = 0; i < header.time_count; ++i)
+			if (type_indices[i] >= header.type_count || (i > 0 && transitions[i] <= transitions[i - 1]))
+			{
+				clear();
+				return false;
+			}
+
+		// The footer is a newline enclosed POSIX TZ string, possibly empty
+		const unsigned char* footer = block + length;
+		const unsigned char* end = data + size;
+		if (time_size == 8 && footer < end && *footer == '\n')
+		{
+			const unsigned char* footer_end = std::find(footer + 1, end, '\n');
+			std::string tz(footer + 1, footer_end);
+			if (footer_end == end || (!tz.empty() && !rule.parse(tz.c_str())))
+			{
+				clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool is_loaded() const
+	{
+		return !offsets.empty();
+	}
+
+	// Name the timezone was loaded with
+	const std::string& name() const
+	{
+		return zone_name;
+	}
+
+	// Get the UTC offset in seconds at an instant given in seconds since
+	// the epoch, UTC
+	int32_t get_offset(int64_t utc) const
+	{
+		if (transitions.empty() || utc >= transitions.back())
+		{
+			if (rule.valid)
+				return rule.get_offset(utc);
+			return transitions.empty() ? offsets[0] : offsets[type_indices.back()];
+		}
+
+		// Instants before the first transition use the first local time type
+		size_t index = std::upper_bound(transitions.begin(), transitions.end(), utc) - transitions.begin();
+		return index == 0 ? offsets[0] : offsets[type_indices[index - 1]];
+	}
+
+	// Get the timezone in hours of a Gregorian date, taken at its local noon
+	// so that it matches most prayer times on days of daylight saving
+	// changes, which happen at night
+	double get_timezone(int year, int month, int day) const
+	{
+		int64_t noon = days_from_civil(year, month, day) * 86400 + 43200;
+		int32_t offset = get_offset(noon);
+		offset = get_offset(noon - offset);
+		return offset / 3600.0;
+	}
+
+	// Get the timezone of each of a range of consecutive days starting at a
+	// Gregorian date, for PrayerTimes::get_prayer_times_range()
+	void get_timezones(int year, int month, int day, int days, double timezones[]) const
+	{
+		int64_t first = days_from_civil(year, month, day);
+		for (int d = 0; d < days; ++d)
+		{
+			int64_t noon = (first + d) * 86400 + 43200;
+			int32_t offset = get_offset(noon);
+			timezones[d] = get_offset(noon - offset) / 3600.0;
+		}
+	}
+
+	// Days from 1970-01-01 to a Gregorian date
+	// Ref: http://howardhinnant.github.io/date_algorithms.html
+	static int64_t days_from_civil(int64_t year, int month, int day)
+	{
+		year -= month <= 2;
+		int64_t era = (year >= 0 ? year : year - 399) / 400;
+		int64_t year_of_era = year - era * 400;
+		int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+		int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+		return era * 146097 + day_of_era - 719468;
+	}
+
+private:
+	static const size_t TZIF_HEADER_SIZE = 44;
+
+	struct TzifHeader
+	{
+		char version;
+		uint32_t isut_count;
+		uint32_t isstd_count;
+		uint32_t leap_count;
+		uint32_t time_count;
+		uint32_t type_count;
+		uint32_t char_count;
+	};
+
+	// Rule of a POSIX TZ string such as "CET-1CEST,M3.5.0,M10.5.0/3"
+	struct PosixRule
+	{
+		// Day of a year on which daylight saving starts or ends
+		struct RuleDate
+		{
+			char kind;		// 'J': 1-365 without Feb 29, 'D': 0-365, 'M': month.week.day
+			int day;
+			int week;
+			int month;
+			int32_t time;		// Local seconds after midnight
+		};
+
+		bool valid;
+		bool has_dst;
+		int32_t std_offset;		// Seconds east of UTC
+		int32_t dst_offset;
+		RuleDate start;
+		RuleDate end;
+
+		PosixRule() : valid(false), has_dst(false), std_offset(0), dst_offset(0)
+		{
+		}
+
+		bool parse(const char* s)
+		{
+			valid = false;
+			if (!parse_name(s) || !parse_offset(s, std_offset))
+				return false;
+			std_offset = -std_offset;		// POSIX offsets are west of UTC
+			has_dst = *s != '\0';
+			if (has_dst)
+			{
+				if (!parse_name(s))
+					return false;
+				dst_offset = std_offset + 3600;
+				if (*s != ',' && *s != '\0')
+				{
+					if (!parse_offset(s, dst_offset))
+						return false;
+					dst_offset = -dst_offset;
+				}
+				if (*s == '\0')
+				{
+					// Unspecified rules default to those of the US
+					const char* us = ",M3.2.0,M11.1.0";
+					if (!parse_dates(us))
+						return false;
+				}
+				else if (!parse_dates(s) || *s != '\0')
+					return false;
+			}
+			valid = true;
+			return true;
+		}
+
+		int32_t get_offset(int64_t utc) const
+		{
+			if (!has_dst)
+				return std_offset;
+
+			// Check the transitions of the year of the instant in standard time
+			int64_t days = floor_div(utc + std_offset, 86400);
+			int64_t year = year_from_days(days);
+			int64_t start_utc = transition_day(start, year) * 86400 + start.time - std_offset;
+			int64_t end_utc = transition_day(end, year) * 86400 + end.time - dst_offset;
+			bool dst = start_utc < end_utc ? utc >= start_utc && utc < end_utc :
+				!(utc >= end_utc && utc < start_utc);
+			return dst ? dst_offset : std_offset;
+		}
+
+		static bool parse_name(const char*& s)
+		{
+			const char* begin = s;
+			if (*s == '<')
+			{
+				const char* end = strchr(s, '>');
+				if (!end)
+					return false;
+				s = end + 1;
+				return end - begin > 1;
+			}
+			while (isalpha((unsigned char) *s))
+				++s;
+			return s - begin >= 3;
+		}
+
+		// Parse [+-]hh[:mm[:ss]] as seconds
+		static bool parse_offset(const char*& s, int32_t& seconds)
+		{
+			int sign = 1;
+			if (*s == '+' || *s == '-')
+				sign = *s++ == '-' ? -1 : 1;
+			if (!isdigit((unsigned char) *s))
+				return false;
+			int32_t value = 0;
+			for (int part = 0; part < 3; ++part)
+			{
+				if (part > 0)
+				{
+					if (*s != ':')
+						break;
+					++s;
+				}
+				char* end;
+				long n = strtol(s, &end, 10);
+				if (end == s || n < 0 || n > (part == 0 ? 167 : 59))
+					return false;
+				s = end;
+				value += n * (part == 0 ? 3600 : part == 1 ? 60 : 1);
+			}
+			seconds = sign * value;
+			return true;
+		}
+
+		bool parse_dates(const char*& s)
+		{
+			return *s++ == ',' && parse_date(s, start) && *s++ == ',' && parse_date(s, end);
+		}
+
+		static bool parse_date(const char*& s, RuleDate& date)
+		{
+			char* end;
+			if (*s == 'M')
+			{
+				date.kind = 'M';
+				date.month = strtol(s + 1, &end, 10);
+				if (*end != '.')
+					return false;
+				date.week = strtol(end + 1, &end, 10);
+				if (*end != '.')
+					return false;
+				date.day = strtol(end + 1, &end, 10);
+				if (date.month < 1 || date.month > 12 || date.week < 1 || date.week > 5 ||
+						date.day < 0 || date.day > 6)
+					return false;
+			}
+			else
+			{
+				date.kind = *s == 'J' ? 'J' : 'D';
+				const char* begin = date.kind == 'J' ? s + 1 : s;
+				date.day = strtol(begin, &end, 10);
+				if (end == begin || date.day < (date.kind == 'J' ? 1 : 0) || date.day > 365)
+					return false;
+			}
+			s = end;
+
+			date.time = 2 * 3600;
+			if (*s == '/')
+				return parse_offset(++s, date.time);
+			return true;
+		}
+
+		// Days from 1970-01-01 to the day a rule date falls on in a year
+		static int64_t transition_day(const RuleDate& date, int64_t year)
+		{
+			bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+			int64_t first = days_from_civil(year, 1, 1);
+			if (date.kind == 'J')
+				return first + date.day - 1 + (leap && date.day >= 60 ? 1 : 0);
+			if (date.kind == 'D')
+				return first + date.day;
+
+			static const int month_days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+			int64_t month_first = days_from_civil(year, date.month, 1);
+			int weekday = (int) floor_mod(month_first + 4, 7);		// 1970-01-01 was a Thursday
+			int64_t day = month_first + (date.day - weekday + 7) % 7 + (date.week - 1) * 7;
+			int length = month_days[date.month - 1] + (leap && date.month == 2 ? 1 : 0);
+			while (day >= month_first + length)
+				day -= 7;
+			return day;
+		}
+
+		static int64_t year_from_days(int64_t days)
+		{
+			int64_t year = 1970 + floor_div(days * 400, 146097);
+			while (days_from_civil(year, 1, 1) > days)
+				--year;
+			while (days_from_civil(year + 1, 1, 1) <= days)
+				++year;
+			return year;
+		}
+	};
+
+	static int64_t floor_div(int64_t a, int64_t b)
+	{
+		return a / b - (a % b < 0 ? 1 : 0);
+	}
+
+	static int64_t floor_mod(int64_t a, int64_t b)
+	{
+		return a - floor_div(a, b) * b;
+	}
+
+	// Read a big-endian two's complement integer
+	static int64_t read_integer(const unsigned char* p, int bytes)
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < bytes; ++i)
+			value = value << 8 | p[i];
+		if (bytes < 8 && (p[0] & 0x80))
+			value |= ~(uint64_t) 0 << (bytes * 8);
+		return (int64_t) value;
+	}
+
+	static bool read_header(const unsigned char* data, size_t size, TzifHeader& header)
+	{
+		if (size < TZIF_HEADER_SIZE || memcmp(data, "TZif", 4) != 0)
+			return false;
+		header.version = data[4];
+		header.isut_count = read_integer(data + 20, 4);
+		header.isstd_count = read_integer(data + 24, 4);
+		header.leap_count = read_integer(data + 28, 4);
+		header.time_count = read_integer(data + 32, 4);
+		header.type_count = read_integer(data + 36, 4);
+		header.char_count = read_integer(data + 40, 4);
+		return header.time_count < (1 << 24) && header.type_count < 256 && header.leap_count < (1 << 24) &&
+			header.char_count < (1 << 24) && header.isut_count <= header.type_count &&
+			header.isstd_count <= header.type_count;
+	}
+
+	// Size of the data block following a header
+	static size_t block_size(const TzifHeader& header, int time_size)
+	{
+		return (size_t) header.time_count * (time_size + 1) + header.type_count * 6 + header.char_count +
+			(size_t) header.leap_count * (time_size + 4) + header.isstd_count + header.isut_count;
+	}
+
+	void clear()
+	{
+		zone_name.clear();
+		transitions.clear();
+		type_indices.clear();
+		offsets.clear();
+		rule = PosixRule();
+	}
+
+	std::string zone_name;
+	std::vector<int64_t> transitions;		// UTC seconds since the epoch
+	std::vector<unsigned char> type_indices;		// Local time type from each transition on
+	std::vector<int32_t> offsets;		// UTC offset of each local time type
+	PosixRule rule;		// Offsets after the last transition
+};
+
+//------------------------- Timezone Cache -------------------------
+
+// Timezones loaded once by name and kept for the lifetime of the cache.
+// Looking up a timezone is thread-safe, and the returned timezone stays
+// valid as long as the cache.
+class TimeZoneCache
+{
+public:
+	explicit TimeZoneCache(const std::string& directory = TZ_DIRECTORY) : directory(directory)
+	{
+	}
+
+	// Get a timezone by name, loading it on first use, or NULL if it can't
+	// be loaded. Failures are cached as well.
+	const TimeZone* get(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, TimeZone>::iterator it = zones.find(name);
+		if (it == zones.end())
+		{
+			it = zones.insert(std::make_pair(name, TimeZone())).first;
+			it->second.load(name, directory.c_str());
+		}
+		return it->second.is_loaded() ? &it->second : NULL;
+	}
+
+	// Cache shared by the whole process, reading TZDIR if set as tzcode does
+	static TimeZoneCache& shared()
+	{
+		static TimeZoneCache cache(getenv("TZDIR") ? getenv("TZDIR") : TZ_DIRECTORY);
+		return cache;
+	}
+
+private:
+	TimeZoneCache(const TimeZoneCache&);
+	TimeZoneCache& operator=(const TimeZoneCache&);
+
+	std::string directory;
+	std::mutex mutex;
+	std::map<std::string, TimeZone> zones;
+};
+
+}
+
+#endif /* PRAYERTIMES_TZFILE_HPP */
@@ -0,0 +1,681 @@
+/*-------------------------- In the name of God ----------------------------*\
+
+    libprayertimes 2.0
+    Offline timezone lookup from coordinates
+
+    Part of libprayertimes, see prayertimes.hpp for copyright and license.
+
+\*--------------------------------------------------------------------------*/
+
+#ifndef PRAYERTIMES_TZMAP_HPP
+#define PRAYERTIMES_TZMAP_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdint.h>
+
+#include "prayertimes.hpp"
+#include "tzfile.hpp"
+
+namespace prayertimes
+{
+
+// Map of timezone boundaries, answering which IANA timezone a point lies in
+// without any network access. Boundaries are loaded from a GeoJSON file
+// such as those released by timezone-boundary-builder: a FeatureCollection
+// whose features have a "tzid" property and a Polygon or MultiPolygon
+// geometry.
+//
+// Boundaries are indexed on a regular grid. Each cell lists the zones it
+// overlaps, whether its center lies inside each of them, and the boundary
+// edges of each zone crossing the cell. A point is then inside a zone if
+// its center is, flipped by every edge crossed going from the center to
+// the point, so lookups only look at the few edges of a single cell.
+//
+// Once loaded the map is never modified, so lookups are thread-safe. As a
+// TimeZoneResolver, it lets PrayerTimes find the timezone of locations
+// given without one.
+class TimeZoneMap : public TimeZoneResolver
+{
+public:
+	TimeZoneMap() : cell_size(0.0), rows(0), columns(0)
+	{
+	}
+
+	// Load and index timezone boundaries, with cells of cell_size degrees.
+	// Timezones are looked up in cache once for all. Returns false if the
+	// file can't be read or isn't valid GeoJSON.
+	bool load(const char* path, TimeZoneCache& cache = TimeZoneCache::shared(), double new_cell_size = 0.5)
+	{
+		clear();
+
+		FILE* file = fopen(path, "rb");
+		if (!file)
+			return false;
+		std::string json;
+		char buffer[65536];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			json.append(buffer, n);
+		bool ok = !ferror(file);
+		fclose(file);
+
+		GeoJsonReader reader(json.data(), json.data() + json.size());
+		if (!ok || !reader.read(*this) || zone_names.empty())
+		{
+			clear();
+			return false;
+		}
+
+		build_index(new_cell_size);
+		for (size_t z = 0; z < zone_names.size(); ++z)
+			zones.push_back(cache.get(zone_names[z]));
+		return true;
+	}
+
+	bool is_loaded() const
+	{
+		return !zone_names.empty();
+	}
+
+	size_t zone_count() const
+	{
+		return zone_names.size();
+	}
+
+	// Get the name of the timezone of a point, or NULL if it lies in no
+	// zone, as in most of the oceans for some data sets
+	const char* find(double latitude, double longitude) const
+	{
+		int z = find_zone(latitude, longitude);
+		return z < 0 ? NULL : zone_names[z].c_str();
+	}
+
+	// Get the timezone of a point, or NULL if it lies in no zone or its
+	// zone isn't known to the timezone cache
+	const TimeZone* find_timezone(double latitude, double longitude) const
+	{
+		int z = find_zone(latitude, longitude);
+		return z < 0 ? NULL : zones[z];
+	}
+
+	// Get the timezone in hours of a point on a Gregorian date. Points in no
+	// known zone get the nautical timezone of their longitude.
+	double get_timezone(double latitude, double longitude, int year, int month, int day) const
+	{
+		const TimeZone* zone = find_timezone(latitude, longitude);
+		if (zone)
+			return zone->get_timezone(year, month, day);
+		return ::floor(longitude / 15.0 + 0.5);
+	}
+
+private:
+	TimeZoneMap(const TimeZoneMap&);
+	TimeZoneMap& operator=(const TimeZoneMap&);
+
+	// A zone overlapping a cell
+	struct CellZone
+	{
+		uint32_t zone;
+		bool center_inside;
+		uint32_t first_edge;		// In cell_edges
+		uint32_t edge_count;
+	};
+
+	// Edge being sorted into the cells it may cross
+	struct PendingEdge
+	{
+		uint32_t cell;
+		uint32_t zone;
+		uint32_t point;
+
+		bool operator<(const PendingEdge& other) const
+		{
+			return cell != other.cell ? cell < other.cell :
+				zone != other.zone ? zone < other.zone : point < other.point;
+		}
+	};
+
+	// Closed ring of points, the last one repeating the first
+	struct Ring
+	{
+		uint32_t zone;
+		uint32_t first_point;		// In points
+		uint32_t point_count;
+	};
+
+	//------------------------ GeoJSON Reader -------------------------
+
+	// Reads the features of a FeatureCollection, ignoring everything but
+	// the tzid property and the coordinates of geometries
+	class GeoJsonReader
+	{
+	public:
+		GeoJsonReader(const char* begin, const char* end) : p(begin), end(end)
+		{
+		}
+
+		bool read(TimeZoneMap& map)
+		{
+			skip_space();
+			if (!expect('{'))
+				return false;
+			std::string key;
+			while (next_member(key))
+			{
+				if (key == "features")
+				{
+					if (!read_features(map))
+						return false;
+				}
+				else if (!skip_value())
+					return false;
+			}
+			return p != NULL;
+		}
+
+	private:
+		bool read_features(TimeZoneMap& map)
+		{
+			if (!expect('['))
+				return false;
+			while (next_element())
+			{
+				std::string name;
+				size_t first_ring = map.rings.size();
+				if (!expect('{'))
+					return false;
+				std::string key;
+				while (next_member(key))
+				{
+					bool ok;
+					if (key == "properties")
+						ok = read_tzid(name);
+					else if (key == "geometry")
+						ok = read_geometry(map);
+					else
+						ok = skip_value();
+					if (!ok)
+						return false;
+				}
+				if (!p)
+					return false;
+
+				// Features without a name don't belong to any zone
+				if (name.empty())
+				{
+					map.points.resize(map.rings.size() > first_ring ? map.rings[first_ring].first_point * 2 :
+							map.points.size());
+					map.rings.resize(first_ring);
+					continue;
+				}
+				uint32_t zone = map.add_zone(name);
+				for (size_t r = first_ring; r < map.rings.size(); ++r)
+					map.rings[r].zone = zone;
+			}
+			return p != NULL;
+		}
+
+		bool read_tzid(std::string& name)
+		{
+			if (!expect('{'))
+				return false;
+			std::string key;
+			while (next_member(key))
+			{
+				if (key == "tzid")
+				{
+					if (!read_string(name))
+						return false;
+				}
+				else if (!skip_value())
+					return false;
+			}
+			return p != NULL;
+		}
+
+		bool read_geometry(TimeZoneMap& map)
+		{
+			if (!expect('{'))
+				return false;
+			std::string key;
+			while (next_member(key))
+			{
+				bool is_point;
+				double x, y;
+				if (key == "coordinates")
+				{
+					if (!read_coordinates(map, is_point, x, y) || is_point)
+						return false;
+				}
+				else if (!skip_value())
+					return false;
+			}
+			return p != NULL;
+		}
+
+		// Read nested arrays of coordinates, adding each array of points
+		// as a ring, whatever the nesting of the geometry type
+		bool read_coordinates(TimeZoneMap& map, bool& is_point, double& x, double& y)
+		{
+			if (!expect('['))
+				return false;
+			skip_space();
+			is_point = p < end && *p != '[' && *p != ']';
+			if (is_point)
+			{
+				// Longitude, latitude and possibly an altitude
+				int count = 0;
+				while (next_element())
+				{
+					double value;
+					if (!read_number(value))
+						return false;
+					if (count == 0)
+						x = value;
+					else if (count == 1)
+						y = value;
+					++count;
+				}
+				return p != NULL && count >= 2;
+			}
+
+			uint32_t first_point = map.points.size() / 2;
+			bool has_points = false;
+			while (next_element())
+			{
+				bool child_is_point;
+				double child_x, child_y;
+				if (!read_coordinates(map, child_is_point, child_x, child_y))
+					return false;
+				if (child_is_point)
+				{
+					map.points.push_back(child_x);
+					map.points.push_back(child_y);
+					has_points = true;
+				}
+			}
+			if (!p)
+				return false;
+			if (has_points)
+				map.add_ring(first_point);
+			return true;
+		}
+
+		void skip_space()
+		{
+			while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+				++p;
+		}
+
+		bool expect(char c)
+		{
+			skip_space();
+			if (p < end && *p == c)
+			{
+				++p;
+				return true;
+			}
+			p = NULL;
+			return false;
+		}
+
+		// Move to the next member of an object and read its key, returning
+		// false at its end. p is NULL on errors.
+		bool next_member(std::string& key)
+		{
+			if (!next_element())
+				return false;
+			if (!read_string(key) || !expect(':'))
+				return false;
+			return true;
+		}
+
+		// Move to the next element of an array or object, returning false at
+		// its end. p is NULL on errors.
+		bool next_element()
+		{
+			if (!p)
+				return false;
+			skip_space();
+			if (p < end && (*p == ']' || *p == '}'))
+			{
+				++p;
+				return false;
+			}
+			if (p < end && *p == ',')
+			{
+				++p;
+				skip_space();
+			}
+			if (p >= end)
+			{
+				p = NULL;
+				return false;
+			}
+			return true;
+		}
+
+		bool read_string(std::string& value)
+		{
+			if (!expect('"'))
+				return false;
+			value.clear();
+			while (p < end && *p != '"')
+			{
+				if (*p == '\\' && ++p < end)
+				{
+					if (*p == 'u')
+					{
+						// Zone names are ASCII, other characters aren't kept
+						value += '?';
+						p += 4;
+					}
+					else
+						value += *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+					++p;
+				}
+				else
+					value += *p++;
+			}
+			if (p >= end)
+			{
+				p = NULL;
+				return false;
+			}
+			++p;
+			return true;
+		}
+
+		bool read_number(double& value)
+		{
+			skip_space();
+			char* number_end;
+			value = strtod(p, &number_end);
+			if (number_end == p || number_end > end)
+			{
+				p = NULL;
+				return false;
+			}
+			p = number_end;
+			return true;
+		}
+
+		// Skip a whole value, counting nested brackets
+		bool skip_value()
+		{
+			skip_space();
+			int depth = 0;
+			while (p < end)
+			{
+				char c = *p;
+				if (c == '"')
+				{
+					std::string ignored;
+					if (!read_string(ignored))
+						return false;
+				}
+				else
+				{
+					if (c == '{' || c == '[')
+						++depth;
+					else if (c == '}' || c == ']')
+					{
+						if (depth == 0)
+							return true;		// End of the enclosing value
+						--depth;
+					}
+					else if (c == ',' && depth == 0)
+						return true;
+					++p;
+				}
+				if (depth == 0 && (c == '"' || c == '}' || c == ']'))
+					return true;
+			}
+			p = NULL;
+			return false;
+		}
+
+		const char* p;
+		const char* end;
+	};
+
+	//------------------------ Index -------------------------
+
+	uint32_t add_zone(const std::string& name)
+	{
+		std::map<std::string, uint32_t>::iterator it = zone_indices.find(name);
+		if (it != zone_indices.end())
+			return it->second;
+		zone_names.push_back(name);
+		zone_indices[name] = zone_names.size() - 1;
+		return zone_names.size() - 1;
+	}
+
+	// Add the points from first_point on as a ring, closing it if needed
+	void add_ring(uint32_t first_point)
+	{
+		uint32_t count = points.size() / 2 - first_point;
+		if (count < 3)
+		{
+			points.resize(first_point * 2);
+			return;
+		}
+		if (points[first_point * 2] != points[points.size() - 2] ||
+				points[first_point * 2 + 1] != points[points.size() - 1])
+		{
+			points.push_back(points[first_point * 2]);
+			points.push_back(points[first_point * 2 + 1]);
+			++count;
+		}
+		Ring ring = { 0, first_point, count };
+		rings.push_back(ring);
+	}
+
+	int row_of(double latitude) const
+	{
+		int row = (int) ::floor((latitude + 90.0) / cell_size);
+		return row < 0 ? 0 : row >= rows ? rows - 1 : row;
+	}
+
+	int column_of(double longitude) const
+	{
+		int column = (int) ::floor((longitude + 180.0) / cell_size);
+		return column < 0 ? 0 : column >= columns ? columns - 1 : column;
+	}
+
+	void build_index(double new_cell_size)
+	{
+		cell_size = new_cell_size;
+		rows = (int) ::ceil(180.0 / cell_size);
+		columns = (int) ::ceil(360.0 / cell_size);
+
+		// Sort every edge into the cells its bounding box covers
+		std::vector<PendingEdge> pending;
+		for (size_t r = 0; r < rings.size(); ++r)
+		{
+			const Ring& ring = rings[r];
+			for (uint32_t i = ring.first_point; i + 1 < ring.first_point + ring.point_count; ++i)
+			{
+				const float* a = &points[i * 2];
+				int row_min = row_of(std::min(a[1], a[3])), row_max = row_of(std::max(a[1], a[3]));
+				int column_min = column_of(std::min(a[0], a[2])), column_max = column_of(std::max(a[0], a[2]));
+				for (int row = row_min; row <= row_max; ++row)
+					for (int column = column_min; column <= column_max; ++column)
+					{
+						PendingEdge edge = { (uint32_t) (row * columns + column), ring.zone, i };
+						pending.push_back(edge);
+					}
+			}
+		}
+		std::sort(pending.begin(), pending.end());
+
+		// Cells of each zone, with the edges crossing them and whether their
+		// center is inside
+		std::vector<std::vector<CellZone> > cells(rows * columns);
+		for (uint32_t z = 0; z < zone_names.size(); ++z)
+		{
+			std::vector<std::vector<double> > crossings;
+			int row_min, row_max, column_min, column_max;
+			zone_crossings(z, crossings, row_min, row_max, column_min, column_max);
+
+			for (int row = row_min; row <= row_max; ++row)
+			{
+				const std::vector<double>& row_crossings = crossings[row - row_min];
+				for (int column = column_min; column <= column_max; ++column)
+				{
+					double center = (column + 0.5) * cell_size - 180.0;
+					size_t before = std::lower_bound(row_crossings.begin(), row_crossings.end(), center) -
+						row_crossings.begin();
+					CellZone cell_zone = { z, before % 2 == 1, 0, 0 };
+					if (cell_zone.center_inside)
+						cells[row * columns + column].push_back(cell_zone);
+				}
+			}
+		}
+
+		// Add the edges, creating entries for cells whose center is outside
+		for (size_t i = 0; i < pending.size(); )
+		{
+			size_t j = i;
+			while (j < pending.size() && pending[j].cell == pending[i].cell && pending[j].zone == pending[i].zone)
+				++j;
+			std::vector<CellZone>& cell = cells[pending[i].cell];
+			size_t k = 0;
+			while (k < cell.size() && cell[k].zone != pending[i].zone)
+				++k;
+			if (k == cell.size())
+			{
+				CellZone cell_zone = { pending[i].zone, false, 0, 0 };
+				cell.push_back(cell_zone);
+			}
+			cell[k].first_edge = i;
+			cell[k].edge_count = j - i;
+			i = j;
+		}
+
+		cell_edges.resize(pending.size());
+		for (size_t i = 0; i < pending.size(); ++i)
+			cell_edges[i] = pending[i].point;
+
+		cell_starts.assign(1, 0);
+		for (size_t c = 0; c < cells.size(); ++c)
+		{
+			cell_zones.insert(cell_zones.end(), cells[c].begin(), cells[c].end());
+			cell_starts.push_back(cell_zones.size());
+		}
+	}
+
+	// Find where the horizontal lines through the cell centers cross the
+	// boundaries of a zone, over the rows and columns its bounding box covers
+	void zone_crossings(uint32_t zone, std::vector<std::vector<double> >& crossings,
+			int& row_min, int& row_max, int& column_min, int& column_max) const
+	{
+		row_min = rows;
+		row_max = -1;
+		column_min = columns;
+		column_max = -1;
+		for (size_t r = 0; r < rings.size(); ++r)
+			if (rings[r].zone == zone)
+				for (uint32_t i = rings[r].first_point; i < rings[r].first_point + rings[r].point_count; ++i)
+				{
+					row_min = std::min(row_min, row_of(points[i * 2 + 1]));
+					row_max = std::max(row_max, row_of(points[i * 2 + 1]));
+					column_min = std::min(column_min, column_of(points[i * 2]));
+					column_max = std::max(column_max, column_of(points[i * 2]));
+				}
+		if (row_max < row_min)
+			return;
+
+		crossings.resize(row_max - row_min + 1);
+		for (size_t r = 0; r < rings.size(); ++r)
+		{
+			if (rings[r].zone != zone)
+				continue;
+			for (uint32_t i = rings[r].first_point; i + 1 < rings[r].first_point + rings[r].point_count; ++i)
+			{
+				double x1 = points[i * 2], y1 = points[i * 2 + 1];
+				double x2 = points[i * 2 + 2], y2 = points[i * 2 + 3];
+				for (int row = row_of(std::min(y1, y2)); row <= row_of(std::max(y1, y2)); ++row)
+				{
+					double y = (row + 0.5) * cell_size - 90.0;
+					if ((y1 > y) != (y2 > y))
+						crossings[row - row_min].push_back(x1 + (y - y1) / (y2 - y1) * (x2 - x1));
+				}
+			}
+		}
+		for (size_t row = 0; row < crossings.size(); ++row)
+			std::sort(crossings[row].begin(), crossings[row].end());
+	}
+
+	// Side of the line through a and b point c lies on
+	static double orientation(double ax, double ay, double bx, double by, double cx, double cy)
+	{
+		return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+	}
+
+	int find_zone(double latitude, double longitude) const
+	{
+		if (cell_starts.empty())
+			return -1;
+		int row = row_of(latitude);
+		int column = column_of(longitude);
+		int cell = row * columns + column;
+		double cx = (column + 0.5) * cell_size - 180.0;
+		double cy = (row + 0.5) * cell_size - 90.0;
+
+		for (uint32_t e = cell_starts[cell]; e < cell_starts[cell + 1]; ++e)
+		{
+			const CellZone& cell_zone = cell_zones[e];
+			bool inside = cell_zone.center_inside;
+			for (uint32_t i = cell_zone.first_edge; i < cell_zone.first_edge + cell_zone.edge_count; ++i)
+			{
+				const float* a = &points[cell_edges[i] * 2];
+				if ((orientation(a[0], a[1], a[2], a[3], cx, cy) > 0) !=
+						(orientation(a[0], a[1], a[2], a[3], longitude, latitude) > 0) &&
+						(orientation(cx, cy, longitude, latitude, a[0], a[1]) > 0) !=
+						(orientation(cx, cy, longitude, latitude, a[2], a[3]) > 0))
+					inside = !inside;
+			}
+			if (inside)
+				return cell_zone.zone;
+		}
+		return -1;
+	}
+
+	void clear()
+	{
+		zone_names.clear();
+		zone_indices.clear();
+		zones.clear();
+		points.clear();
+		rings.clear();
+		cell_starts.clear();
+		cell_zones.clear();
+		cell_edges.clear();
+	}
+
+	double cell_size;		// In degrees
+	int rows;
+	int columns;
+
+	std::vector<std::string> zone_names;
+	std::map<std::string, uint32_t> zone_indices;
+	std::vector<const TimeZone*> zones;		// From the cache, NULL if unknown
+	std::vector<float> points;		// Longitude and latitude of ring points
+	std::vector<Ring> rings;
+
+	std::vector<uint32_t> cell_starts;		// Index of the first CellZone of each cell, and the end
+	std::vector<CellZone> cell_zones;
+	std::vector<uint32_t> cell_edges;		// Index in points of the first point of each edge
+};
+
+}
+
+#endif /* PRAYERTIMES_TZMAP_HPP */
@@ -17,9 +17,16 @@
 
 import QtQuick 2.1
 import Sailfish.Silica 1.0
+import Harbour.Prayer 1.0
 
 Dialog {
-    canAccept: name.text != "" && longitude.text >= 0 && latitude.text >= 0 && altitude.text >= 0
+    canAccept: name.text != "" && isCoordinate(longitude.text, 180) && isCoordinate(latitude.text, 90) &&
+               altitude.text != "" && !isNaN(altitude.text)
+
+    // Cities of the whole world have negative coordinates and elevations
+    function isCoordinate(text, limit) {
+        return text != "" && !isNaN(text) && Math.abs(text) <= limit
+    }
 
     Column {
         width: parent.width
@@ -29,6 +36,49 @@ Dialog {
             acceptText: qsTr("Change city")
         }
 
+        CitySearchModel {
+            id: cities
+            query: search.text
+            limit: 5
+        }
+
+        SearchField {
+            id: search
+            width: parent.width
+            placeholderText: qsTr("Search city")
+            visible: cities.available
+        }
+
+        Repeater {
+            model: cities
+
+            BackgroundItem {
+                width: parent.width
+
+                Label {
+                    anchors {
+                        left: parent.left
+                        leftMargin: Theme.paddingLarge
+                        right: parent.right
+                        rightMargin: Theme.paddingLarge
+                        verticalCenter: parent.verticalCenter
+                    }
+
+                    truncationMode: TruncationMode.Fade
+                    text: model.name + ", " + model.country
+                    color: highlighted ? Theme.highlightColor : Theme.primaryColor
+                }
+
+                onClicked: {
+                    name.text = model.name
+                    longitude.text = model.longitude
+                    latitude.text = model.latitude
+                    altitude.text = model.elevation
+                    search.text = ""
+                }
+            }
+        }
+
         Item {
             width: parent.width
             height: Theme.itemSizeMedium
@@ -87,7 +137,7 @@ Dialog {
 
                 width: (parent.width / 2) - Theme.paddingLarge
                 horizontalAlignment: Text.AlignHCenter
-                inputMethodHints: Qt.ImhDigitsOnly
+                inputMethodHints: Qt.ImhFormattedNumbersOnly
                 text: settings.longitude
             }
         }
@@ -119,7 +169,7 @@ Dialog {
 
                 width: (parent.width / 2) - Theme.paddingLarge
                 horizontalAlignment: Text.AlignHCenter
-                inputMethodHints: Qt.ImhDigitsOnly
+                inputMethodHints: Qt.ImhFormattedNumbersOnly
                 text: settings.latitude
             }
         }
@@ -151,11 +201,26 @@ Dialog {
 
                 width: (parent.width / 2) - Theme.paddingLarge
                 horizontalAlignment: Text.AlignHCenter
-                inputMethodHints: Qt.ImhDigitsOnly
+                inputMethodHints: Qt.ImhFormattedNumbersOnly
                 text: settings.altitude
             }
         }
 
+        Button {
+            anchors.horizontalCenter: parent.horizontalCenter
+            text: qsTr("Nearest city")
+            visible: cities.available
+            enabled: longitude.text != "" && latitude.text != ""
+
+            onClicked: {
+                var city = cities.nearest(latitude.text, longitude.text)
+                if (city.name) {
+                    name.text = city.name
+                    altitude.text = city.elevation
+                }
+            }
+        }
+
         ComboBox {
             id: calculationMethod
             menu: ContextMenu {
@@ -174,10 +239,12 @@ Dialog {
     }
 
     onAccepted: {
+        settings.begin()
         settings.locationName = name.text
         settings.longitude = longitude.text
         settings.latitude = latitude.text
         settings.altitude = altitude.text
         settings.calculationMethod = calculationMethod.currentIndex
+        settings.commit()
     }
 }
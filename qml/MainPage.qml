@@ -29,34 +29,45 @@ Page {
         calculationMethod: settings.calculationMethod
     }
 
+    PrayerScheduler {
+        id: scheduler
+        calculator: calculator
+    }
+
     property list<QtObject> prayerModel: [
         QtObject {
             property variant stamp: calculator.fajrTime
+            property int position: PrayerTimeCalculator.Fajr
             property string name: qsTr("Fajr")
             property bool nextDay
         },
         QtObject {
             property variant stamp: calculator.sunriseTime
+            property int position: PrayerTimeCalculator.Sunrise
             property string name: qsTr("Sunrise")
             property bool nextDay
         },
         QtObject {
             property variant stamp: calculator.dhuhrTime
+            property int position: PrayerTimeCalculator.Dhuhr
             property string name: qsTr("Dhuhr")
             property bool nextDay
         },
         QtObject {
             property variant stamp: calculator.asrTime
+            property int position: PrayerTimeCalculator.Asr
             property string name: qsTr("Asr")
             property bool nextDay
         },
         QtObject {
             property variant stamp: calculator.maghribTime
+            property int position: PrayerTimeCalculator.Maghrib
             property string name: qsTr("Maghrib")
             property bool nextDay
         },
         QtObject {
             property variant stamp: calculator.ishaTime
+            property int position: PrayerTimeCalculator.Isha
             property string name: qsTr("Isha")
             property bool nextDay: calculator.ishaIsNextDay
         }
@@ -69,6 +80,7 @@ Page {
         PullDownMenu {
             MenuItem { text: qsTr("About"); onClicked: Qt.resolvedUrl("AboutPage.qml") }
             MenuItem { text: qsTr("Change city"); onClicked: pageStack.push(Qt.resolvedUrl("LocationPage.qml")) }
+            MenuItem { text: qsTr("Timetable"); onClicked: pageStack.push(Qt.resolvedUrl("TimetablePage.qml")) }
             MenuItem { text: qsTr("Settings"); onClicked: Qt.resolvedUrl("SettingsPage.qml") }
         }
 
@@ -105,6 +117,7 @@ Page {
 
                 width: (parent.width / 2) - Theme.paddingLarge
                 horizontalAlignment: Text.AlignRight
+                color: position == scheduler.nextPrayer ? Theme.highlightColor : Theme.primaryColor
                 text: "%1 %2".arg(Qt.formatDateTime(stamp, "hh:mm")).arg(nextDay ? '*' : ' ')
             }
         }
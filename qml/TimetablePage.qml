@@ -0,0 +1,87 @@
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+import QtQuick 2.1
+import Sailfish.Silica 1.0
+import Harbour.Prayer 1.0
+
+Page {
+
+    TimetableModel {
+        id: timetable
+        longitude: settings.longitude
+        latitude: settings.latitude
+        altitude: settings.altitude
+        calculationMethod: settings.calculationMethod
+    }
+
+    SilicaListView {
+        id: view
+        anchors.fill: parent
+
+        header: PageHeader {
+            width: parent.width
+            title: qsTr("Timetable")
+        }
+
+        model: timetable
+
+        delegate: Item {
+            width: view.width
+            height: Theme.itemSizeSmall
+
+            property variant stamps: [fajr, sunrise, dhuhr, asr, maghrib, isha]
+
+            Label {
+                id: day
+                height: Theme.itemSizeSmall
+                anchors {
+                    left: parent.left
+                    leftMargin: Theme.paddingLarge
+                    top: parent.top
+                }
+
+                width: parent.width / 4
+                color: Theme.highlightColor
+                text: Qt.formatDate(date, "ddd d MMM")
+            }
+
+            Row {
+                anchors {
+                    left: day.right
+                    right: parent.right
+                    rightMargin: Theme.paddingLarge
+                    top: parent.top
+                }
+
+                Repeater {
+                    model: stamps
+
+                    Label {
+                        height: Theme.itemSizeSmall
+                        width: parent.width / 6
+                        horizontalAlignment: Text.AlignRight
+                        font.pixelSize: Theme.fontSizeSmall
+                        text: modelData ? Qt.formatDateTime(modelData, "hh:mm") : "--:--"
+                    }
+                }
+            }
+        }
+
+        VerticalScrollDecorator { }
+    }
+}
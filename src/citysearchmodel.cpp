@@ -0,0 +1,158 @@
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "citysearchmodel.h"
+#include "citydb.hpp"
+#include <QCoreApplication>
+#include <QFile>
+
+#define DEFAULT_LIMIT         20
+
+// Installed with the application data
+static QString databasePath() {
+  return QCoreApplication::applicationDirPath() + "/../share/" +
+    QCoreApplication::applicationName() + "/cities.db";
+}
+
+// Mapped on first use and kept until the application exits
+static const prayertimes::CityDatabase& database() {
+  static prayertimes::CityDatabase db;
+  static bool opened = false;
+
+  if (!opened) {
+    opened = true;
+    db.open(QFile::encodeName(databasePath()).constData());
+  }
+
+  return db;
+}
+
+CitySearchModel::CitySearchModel(QObject *parent) :
+  QAbstractListModel(parent),
+  m_limit(DEFAULT_LIMIT) {
+
+}
+
+CitySearchModel::~CitySearchModel() {
+
+}
+
+QString CitySearchModel::query() const {
+  return m_query;
+}
+
+void CitySearchModel::setQuery(const QString& query) {
+  if (m_query != query) {
+    m_query = query;
+    emit queryChanged();
+    search();
+  }
+}
+
+int CitySearchModel::limit() const {
+  return m_limit;
+}
+
+void CitySearchModel::setLimit(int limit) {
+  if (m_limit != limit) {
+    m_limit = limit;
+    emit limitChanged();
+    search();
+  }
+}
+
+bool CitySearchModel::isAvailable() const {
+  return database().is_open();
+}
+
+int CitySearchModel::rowCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : m_cities.size();
+}
+
+QVariant CitySearchModel::data(const QModelIndex& index, int role) const {
+  if (!index.isValid() || index.row() >= m_cities.size()) {
+    return QVariant();
+  }
+
+  return cityData(m_cities[index.row()], role);
+}
+
+QHash<int, QByteArray> CitySearchModel::roleNames() const {
+  QHash<int, QByteArray> roles;
+  roles[NameRole] = "name";
+  roles[CountryRole] = "country";
+  roles[LatitudeRole] = "latitude";
+  roles[LongitudeRole] = "longitude";
+  roles[ElevationRole] = "elevation";
+  roles[TimezoneRole] = "timezone";
+  return roles;
+}
+
+QVariantMap CitySearchModel::nearest(qreal latitude, qreal longitude) const {
+  QVariantMap city;
+  const prayertimes::CityDatabase& db = database();
+  double distance;
+  long index = db.is_open() ? db.find_nearest(latitude, longitude, HUGE_VAL, &distance) : -1;
+
+  if (index >= 0) {
+    QHash<int, QByteArray> roles = roleNames();
+    for (QHash<int, QByteArray>::const_iterator it = roles.constBegin(); it != roles.constEnd(); ++it) {
+      city[it.value()] = cityData(index, it.key());
+    }
+
+    city["distance"] = distance;
+  }
+
+  return city;
+}
+
+QVariant CitySearchModel::cityData(uint32_t index, int role) {
+  const prayertimes::CityDatabase& db = database();
+  const prayertimes::CityRecord& city = db.city(index);
+
+  switch (role) {
+  case NameRole:
+    return QString::fromUtf8(db.name(city));
+  case CountryRole:
+    return QString::fromLatin1(city.country, qstrnlen(city.country, sizeof(city.country)));
+  case LatitudeRole:
+    return city.latitude;
+  case LongitudeRole:
+    return city.longitude;
+  case ElevationRole:
+    return city.elevation;
+  case TimezoneRole:
+    return QString::fromLatin1(db.timezone(city));
+  default:
+    return QVariant();
+  }
+}
+
+void CitySearchModel::search() {
+  const prayertimes::CityDatabase& db = database();
+
+  QVector<uint32_t> cities;
+  if (db.is_open() && m_limit > 0) {
+    cities.resize(qMin<int>(m_limit, prayertimes::CityDatabase::CITY_SEARCH_MAX));
+    cities.resize(db.search(m_query.toUtf8().constData(), cities.data(), cities.size()));
+  }
+
+  beginResetModel();
+  m_cities = cities;
+  endResetModel();
+}
@@ -0,0 +1,82 @@
+// -*-c++-*-
+
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CITY_SEARCH_MODEL_H
+#define CITY_SEARCH_MODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QVariantMap>
+#include <stdint.h>
+
+// Cities of the bundled city database whose name starts with the query,
+// best matches first. The database is mapped once and shared by all
+// models, and searching it takes microseconds, so results are updated
+// as the query is typed.
+class CitySearchModel : public QAbstractListModel {
+  Q_OBJECT
+
+  Q_PROPERTY(QString query READ query WRITE setQuery NOTIFY queryChanged);
+  Q_PROPERTY(int limit READ limit WRITE setLimit NOTIFY limitChanged);
+  Q_PROPERTY(bool available READ isAvailable CONSTANT);
+
+public:
+  enum {
+    NameRole = Qt::UserRole + 1,
+    CountryRole,
+    LatitudeRole,
+    LongitudeRole,
+    ElevationRole,
+    TimezoneRole,
+  };
+
+  CitySearchModel(QObject *parent = 0);
+  ~CitySearchModel();
+
+  QString query() const;
+  void setQuery(const QString& query);
+
+  int limit() const;
+  void setLimit(int limit);
+
+  // Whether the city database could be opened
+  bool isAvailable() const;
+
+  // City nearest to a point, with the roles of the model as keys and its
+  // distance in meters as "distance", or an empty map if there is none
+  Q_INVOKABLE QVariantMap nearest(qreal latitude, qreal longitude) const;
+
+  int rowCount(const QModelIndex& parent = QModelIndex()) const;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+  QHash<int, QByteArray> roleNames() const;
+
+signals:
+  void queryChanged();
+  void limitChanged();
+
+private:
+  void search();
+  static QVariant cityData(uint32_t index, int role);
+
+  QVector<uint32_t> m_cities;
+  QString m_query;
+  int m_limit;
+};
+
+#endif /* CITY_SEARCH_MODEL_H */
@@ -24,6 +24,9 @@
 #include <QDebug>
 #include "settings.h"
 #include "prayertimecalculator.h"
+#include "timetablemodel.h"
+#include "prayerscheduler.h"
+#include "citysearchmodel.h"
 
 Q_DECL_EXPORT int
 main(int argc, char *argv[]) {
@@ -31,6 +34,10 @@ main(int argc, char *argv[]) {
   QScopedPointer<QQuickView> view(MDeclarativeCache::qQuickView());
 
   app->setApplicationName("harbour-prayer");
+
+  // The first page shows the times saved by the last run, before settings
+  // are read and times are calculated
+  PrayerTimeCalculator::loadSnapshot();
   app->setApplicationDisplayName(QObject::tr("Prayer times"));
 
   view->setTitle(app->applicationDisplayName());
@@ -42,6 +49,9 @@ main(int argc, char *argv[]) {
 
   qmlRegisterType<Settings>("Harbour.Prayer", 1, 0, "Settings");
   qmlRegisterType<PrayerTimeCalculator>("Harbour.Prayer", 1, 0, "PrayerTimeCalculator");
+  qmlRegisterType<TimetableModel>("Harbour.Prayer", 1, 0, "TimetableModel");
+  qmlRegisterType<PrayerScheduler>("Harbour.Prayer", 1, 0, "PrayerScheduler");
+  qmlRegisterType<CitySearchModel>("Harbour.Prayer", 1, 0, "CitySearchModel");
 
   view->setSource(QUrl("qrc:/qml/main.qml"));
   if (view->status() == QQuickView::Error) {
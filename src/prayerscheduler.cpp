@@ -0,0 +1,116 @@
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "prayerscheduler.h"
+
+#define MAX_INTERVAL          (24 * 3600 * 1000)
+
+PrayerScheduler::PrayerScheduler(QObject *parent) :
+  QObject(parent),
+  m_nextPrayer(-1) {
+
+  // Coarse timers may fire a whole second late, which shows at a prayer
+  m_timer.setSingleShot(true);
+  m_timer.setTimerType(Qt::PreciseTimer);
+  QObject::connect(&m_timer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+PrayerScheduler::~PrayerScheduler() {
+
+}
+
+PrayerTimeCalculator *PrayerScheduler::calculator() const {
+  return m_calculator;
+}
+
+void PrayerScheduler::setCalculator(PrayerTimeCalculator *calculator) {
+  if (m_calculator != calculator) {
+    if (m_calculator) {
+      QObject::disconnect(m_calculator, SIGNAL(prayerTimesChanged()), this, SLOT(schedule()));
+    }
+
+    m_calculator = calculator;
+    if (m_calculator) {
+      QObject::connect(m_calculator, SIGNAL(prayerTimesChanged()), this, SLOT(schedule()));
+    }
+
+    emit calculatorChanged();
+    schedule();
+  }
+}
+
+int PrayerScheduler::nextPrayer() const {
+  return m_nextPrayer;
+}
+
+QDateTime PrayerScheduler::nextPrayerTime() const {
+  return m_nextPrayerTime;
+}
+
+void PrayerScheduler::schedule() {
+  m_timer.stop();
+
+  int nextPrayer = -1;
+  QDateTime nextPrayerTime;
+  QDateTime now = QDateTime::currentDateTime();
+
+  if (m_calculator) {
+    QMap<int, QDateTime> times = m_calculator->times();
+    for (QMap<int, QDateTime>::const_iterator it = times.constBegin(); it != times.constEnd(); ++it) {
+      if (it.value() > now && (nextPrayer < 0 || it.value() < nextPrayerTime)) {
+        nextPrayer = it.key();
+        nextPrayerTime = it.value();
+      }
+    }
+  }
+
+  if (nextPrayer != m_nextPrayer || nextPrayerTime != m_nextPrayerTime) {
+    m_nextPrayer = nextPrayer;
+    m_nextPrayerTime = nextPrayerTime;
+    emit nextPrayerChanged();
+  }
+
+  if (!m_calculator || !m_calculator->date().isValid()) {
+    return;
+  }
+
+  // Once the last prayer passed, wait for the day after the times. Clock
+  // changes are caught up with at least once a day.
+  QDateTime next = nextPrayer >= 0 ? nextPrayerTime : QDateTime(m_calculator->date().addDays(1));
+  m_timer.start(int(qBound(qint64(0), now.msecsTo(next), qint64(MAX_INTERVAL))));
+}
+
+void PrayerScheduler::timeout() {
+  if (!m_calculator) {
+    return;
+  }
+
+  QDateTime now = QDateTime::currentDateTime();
+  if (m_nextPrayer >= 0 && m_nextPrayerTime <= now) {
+    emit prayerReached(m_nextPrayer);
+  }
+
+  // The calculator moves to today, from its saved days when it can, and
+  // signals its new times, which schedules the next event
+  if (m_nextPrayer < 0 && m_calculator->date() < now.date()) {
+    emit dayChanged();
+    m_calculator->calculate();
+    return;
+  }
+
+  schedule();
+}
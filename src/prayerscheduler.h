@@ -0,0 +1,68 @@
+// -*-c++-*-
+
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PRAYER_SCHEDULER_H
+#define PRAYER_SCHEDULER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QPointer>
+#include <QTimer>
+#include "prayertimecalculator.h"
+
+// Follows the times of a calculator as the clock moves: it signals each
+// prayer as it is reached, and moves the calculator to the next day once
+// the last prayer of the day passed midnight. A single timer is armed for
+// the next of these events, so nothing runs in between.
+class PrayerScheduler : public QObject {
+  Q_OBJECT
+
+  Q_PROPERTY(PrayerTimeCalculator *calculator READ calculator WRITE setCalculator NOTIFY calculatorChanged);
+  Q_PROPERTY(int nextPrayer READ nextPrayer NOTIFY nextPrayerChanged);
+  Q_PROPERTY(QDateTime nextPrayerTime READ nextPrayerTime NOTIFY nextPrayerChanged);
+
+public:
+  PrayerScheduler(QObject *parent = 0);
+  ~PrayerScheduler();
+
+  PrayerTimeCalculator *calculator() const;
+  void setCalculator(PrayerTimeCalculator *calculator);
+
+  // Position of the next prayer in the calculator times, or -1
+  int nextPrayer() const;
+  QDateTime nextPrayerTime() const;
+
+signals:
+  void calculatorChanged();
+  void nextPrayerChanged();
+  void prayerReached(int prayer);
+  void dayChanged();
+
+private slots:
+  void schedule();
+  void timeout();
+
+private:
+  QPointer<PrayerTimeCalculator> m_calculator;
+  QTimer m_timer;
+  int m_nextPrayer;
+  QDateTime m_nextPrayerTime;
+};
+
+#endif /* PRAYER_SCHEDULER_H */
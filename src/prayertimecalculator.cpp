@@ -18,7 +18,7 @@
 #include "prayertimecalculator.h"
 #include "prayertimes.hpp"
 #include <QDate>
-#include <QDebug>
+#include <QtConcurrentRun>
 
 #define FAJR_POSITION         prayertimes::Fajr
 #define SUNRISE_POSITION      prayertimes::Sunrise
@@ -27,17 +27,43 @@
 #define MAGHRIB_POSITION      prayertimes::Maghrib
 #define ISHA_POSITION         prayertimes::Isha
 
+#define SNAPSHOT_DAYS         7
+
+// Times of the last run, then of the last calculation
+static TimesSnapshot snapshot;
+
+static QList<int> positions() {
+  QList<int> positions;
+  positions << FAJR_POSITION << SUNRISE_POSITION << DHUHR_POSITION << ASR_POSITION << MAGHRIB_POSITION << ISHA_POSITION;
+  return positions;
+}
+
 PrayerTimeCalculator::PrayerTimeCalculator(QObject *parent) :
   QObject(parent),
-  m_longitude(-1),
-  m_latitude(-1),
-  m_altitude(-1),
+  m_dirty(false),
+  m_longitude(qQNaN()),
+  m_latitude(qQNaN()),
+  m_altitude(qQNaN()),
   m_calculationMethod(-1) {
 
+  // Changes made in the same event loop turn, like the bindings of all
+  // properties at startup, are calculated once
+  m_timer.setSingleShot(true);
+  m_timer.setInterval(0);
+  QObject::connect(&m_timer, SIGNAL(timeout()), this, SLOT(calculate()));
+  QObject::connect(&m_watcher, SIGNAL(finished()), this, SLOT(calculationFinished()));
+
+  // Show the times of the last run until properties are set, they are
+  // only calculated again if they don't match
+  QDate today = QDate::currentDate();
+  if (snapshot.covers(today, snapshot.key())) {
+    m_times = snapshot.times(today, positions());
+    m_date = today;
+  }
 }
 
 PrayerTimeCalculator::~PrayerTimeCalculator() {
-
+  m_watcher.waitForFinished();
 }
 
 qreal PrayerTimeCalculator::longitude() const {
@@ -48,7 +74,7 @@ void PrayerTimeCalculator::setLongitude(qreal longitude) {
   if (!qFuzzyCompare(m_longitude, longitude)) {
     m_longitude = longitude;
     emit longitudeChanged();
-    calculate();
+    scheduleCalculation();
   }
 }
 
@@ -60,7 +86,7 @@ void PrayerTimeCalculator::setLatitude(qreal latitude) {
   if (!qFuzzyCompare(m_latitude, latitude)) {
     m_latitude = latitude;
     emit latitudeChanged();
-    calculate();
+    scheduleCalculation();
   }
 }
 
@@ -72,7 +98,7 @@ void PrayerTimeCalculator::setAltitude(qreal altitude) {
   if (!qFuzzyCompare(m_altitude, altitude)) {
     m_altitude = altitude;
     emit altitudeChanged();
-    calculate();
+    scheduleCalculation();
   }
 }
 
@@ -84,64 +110,110 @@ void PrayerTimeCalculator::setCalculationMethod(int calculationMethod) {
   if (m_calculationMethod != calculationMethod) {
     m_calculationMethod = calculationMethod;
     emit calculationMethodChanged();
-    calculate();
+    scheduleCalculation();
+  }
+}
+
+void PrayerTimeCalculator::scheduleCalculation() {
+  if (!m_timer.isActive()) {
+    m_timer.start();
   }
 }
 
 void PrayerTimeCalculator::calculate() {
-  if (m_longitude < 0 || m_latitude < 0 || m_altitude < 0 || m_calculationMethod < 0) {
+  m_timer.stop();
+
+  // Coordinates may be negative, so unset ones are NaN
+  if (qIsNaN(m_longitude) || qIsNaN(m_latitude) || qIsNaN(m_altitude) || m_calculationMethod < 0) {
     return;
   }
 
-  prayertimes::PrayerTimes times;
-  time_t date = time(NULL);
-  qreal timezone = prayertimes::PrayerTimes::get_timezone(date);
-  qDebug() << timezone;
-  double output[prayertimes::TimesCount];
+  // Only one calculation runs at a time, the latest values are calculated
+  // again once it finishes
+  if (m_watcher.isRunning()) {
+    m_dirty = true;
+    return;
+  }
 
-  times.set_calc_method(static_cast<prayertimes::CalculationMethod>(m_calculationMethod));
-  times.get_prayer_times(date, m_latitude, m_longitude, m_altitude, timezone, output);
-  m_times.clear();
+  QDate today = QDate::currentDate();
+  if (snapshot.covers(today, TimesSnapshot::key(m_longitude, m_latitude, m_altitude, m_calculationMethod))) {
+    QMap<int, double> times = snapshot.times(today, positions());
+    if (times != m_times || today != m_date) {
+      m_times = times;
+      m_date = today;
+      emit prayerTimesChanged();
+    }
+    return;
+  }
 
-  QList<int> positions;
-  positions << FAJR_POSITION << SUNRISE_POSITION << DHUHR_POSITION << ASR_POSITION << MAGHRIB_POSITION << ISHA_POSITION;
-  for (int x = 0; x < positions.size(); x++) {
-    m_times.insert(positions[x], output[positions[x]]);
+  Input input;
+  input.longitude = m_longitude;
+  input.latitude = m_latitude;
+  input.altitude = m_altitude;
+  input.calculationMethod = m_calculationMethod;
+  input.date = today;
+
+  m_dirty = false;
+  m_watcher.setFuture(QtConcurrent::run(&PrayerTimeCalculator::compute, input));
+}
+
+void PrayerTimeCalculator::calculationFinished() {
+  if (m_dirty) {
+    calculate();
+    return;
   }
 
+  snapshot = m_watcher.result();
+  m_date = QDate::currentDate();
+  m_times = snapshot.times(m_date, positions());
+
   emit prayerTimesChanged();
 }
 
-QDateTime PrayerTimeCalculator::get(int pos) const {
-  if (!m_times.contains(pos)) {
-    return QDateTime();
+// Runs on a worker thread, and so only uses its input. The days ahead are
+// saved for the next start.
+TimesSnapshot PrayerTimeCalculator::compute(const Input& input) {
+  TimesSnapshot result = TimesSnapshot::compute(input.longitude, input.latitude, input.altitude,
+                                                input.calculationMethod, input.date, SNAPSHOT_DAYS);
+  if (!result.save(TimesSnapshot::defaultPath())) {
+    qWarning("Failed to save times snapshot to %s", qPrintable(TimesSnapshot::defaultPath()));
   }
 
-  double time = m_times[pos];
+  return result;
+}
 
-  bool addDays = false;
-  int seconds = time;
-  int hours = seconds / 3600;
-  seconds %= 3600;
-  int minutes = seconds / 60;
-  seconds %= 60;
+bool PrayerTimeCalculator::loadSnapshot() {
+  return snapshot.load(TimesSnapshot::defaultPath());
+}
 
-  if (hours >= 24) {
-    hours -= 24;
-    addDays = true;
+QDateTime PrayerTimeCalculator::get(int pos) const {
+  if (!m_times.contains(pos) || qIsNaN(m_times[pos])) {
+    return QDateTime();
   }
 
-  QTime t = QTime(hours, minutes, seconds);
-  QDateTime dt = QDateTime::currentDateTime();
-  if (addDays) {
-    dt.addDays(1);
-  }
+  // Times are wall clock seconds from the midnight starting the day they
+  // were calculated for, past 24 hours on the next day
+  int seconds = qRound(m_times[pos]);
+  int days = seconds >= 0 ? seconds / 86400 : -((86399 - seconds) / 86400);
+  seconds -= days * 86400;
 
-  dt.setTime(t);
+  return QDateTime(m_date.addDays(days), QTime(0, 0).addSecs(seconds));
+}
+
+QDate PrayerTimeCalculator::date() const {
+  return m_date;
+}
 
-  qDebug() << hours << minutes << seconds << addDays;
+QMap<int, QDateTime> PrayerTimeCalculator::times() const {
+  QMap<int, QDateTime> times;
+  foreach (int pos, m_times.keys()) {
+    QDateTime time = get(pos);
+    if (time.isValid()) {
+      times.insert(pos, time);
+    }
+  }
 
-  return dt;
+  return times;
 }
 
 QDateTime PrayerTimeCalculator::fajrTime() const {
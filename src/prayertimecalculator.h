@@ -23,6 +23,10 @@
 #include <QObject>
 #include <QDateTime>
 #include <QMap>
+#include <QTimer>
+#include <QFutureWatcher>
+#include "timessnapshot.h"
+#include "prayertimes.hpp"
 
 class PrayerTimeCalculator : public QObject {
   Q_OBJECT
@@ -39,7 +43,20 @@ class PrayerTimeCalculator : public QObject {
   Q_PROPERTY(QDateTime maghribTime READ maghribTime NOTIFY prayerTimesChanged);
   Q_PROPERTY(QDateTime ishaTime READ ishaTime NOTIFY prayerTimesChanged);
   Q_PROPERTY(bool ishaIsNextDay READ ishaIsNextDay NOTIFY prayerTimesChanged);
+
+  Q_ENUMS(Prayer);
 public:
+  // Positions of the prayers in times(), as compared to
+  // PrayerScheduler::nextPrayer
+  enum Prayer {
+    Fajr = prayertimes::Fajr,
+    Sunrise = prayertimes::Sunrise,
+    Dhuhr = prayertimes::Dhuhr,
+    Asr = prayertimes::Asr,
+    Maghrib = prayertimes::Maghrib,
+    Isha = prayertimes::Isha
+  };
+
   PrayerTimeCalculator(QObject *parent = 0);
   ~PrayerTimeCalculator();
 
@@ -64,9 +81,20 @@ public:
 
   bool ishaIsNextDay() const;
 
+  // Date the times are calculated for, and the times by position
+  QDate date() const;
+  QMap<int, QDateTime> times() const;
+
+  // Read the times saved by the last run, for calculators created next to
+  // show before calculating anything
+  static bool loadSnapshot();
+
 public slots:
   void calculate();
 
+private slots:
+  void calculationFinished();
+
 signals:
   void longitudeChanged();
   void latitudeChanged();
@@ -75,9 +103,23 @@ signals:
   void prayerTimesChanged();
 
 private:
+  struct Input {
+    qreal longitude;
+    qreal latitude;
+    qreal altitude;
+    int calculationMethod;
+    QDate date;
+  };
+
   QDateTime get(int pos) const;
+  void scheduleCalculation();
+  static TimesSnapshot compute(const Input& input);
 
   QMap<int, double> m_times;
+  QDate m_date;
+  QTimer m_timer;
+  QFutureWatcher<TimesSnapshot> m_watcher;
+  bool m_dirty;
 
   qreal m_longitude;
   qreal m_latitude;
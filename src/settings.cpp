@@ -19,6 +19,7 @@
 #include <QStandardPaths>
 #include <QCoreApplication>
 #include <QDir>
+#include <QtConcurrentRun>
 #include "prayertimes.hpp"
 
 #define CONF_FILE_PATH QString("%1%2%3%2%3.conf") \
@@ -33,65 +34,137 @@
 #define DEFAULT_CALCULATION_METHOD      int(prayertimes::Egypt)
 
 Settings::Settings(QObject *parent) :
-  QSettings(CONF_FILE_PATH, QSettings::IniFormat, parent) {
-
+  QSettings(CONF_FILE_PATH, QSettings::IniFormat, parent),
+  m_transactions(0),
+  m_changed(false),
+  m_dirty(false) {
+
+  m_values.longitude = value("location/longitude", DEFAULT_LONGITUDE).toReal();
+  m_values.latitude = value("location/latitude", DEFAULT_LATITUDE).toReal();
+  m_values.altitude = value("location/altitude", DEFAULT_ALTITUDE).toReal();
+  m_values.locationName = value("location/name", DEFAULT_LOCATION_NAME).toString();
+  m_values.calculationMethod = value("location/calculationMethod", DEFAULT_CALCULATION_METHOD).toInt();
+
+  // Changes made in the same event loop turn are written once
+  m_flushTimer.setSingleShot(true);
+  m_flushTimer.setInterval(0);
+  QObject::connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+  QObject::connect(&m_flushWatcher, SIGNAL(finished()), this, SLOT(flushFinished()));
 }
 
 Settings::~Settings() {
-
+  m_flushWatcher.waitForFinished();
+  if (m_dirty) {
+    write(fileName(), m_values);
+  }
 }
 
 qreal Settings::longitude() const {
-  return value("location/longitude", DEFAULT_LONGITUDE).toReal();
+  return m_values.longitude;
 }
 
 void Settings::setLongitude(qreal longitude) {
-  if (!qFuzzyCompare(Settings::longitude(), longitude)) {
-    setValue("location/longitude", longitude);
-    emit longitudeChanged();
+  if (!qFuzzyCompare(m_values.longitude, longitude)) {
+    m_values.longitude = longitude;
+    changed();
   }
 }
 
 qreal Settings::latitude() const {
-  return value("location/latitude", DEFAULT_LATITUDE).toReal();
+  return m_values.latitude;
 }
 
 void Settings::setLatitude(qreal latitude) {
-  if (!qFuzzyCompare(Settings::latitude(), latitude)) {
-    setValue("location/latitude", latitude);
-    emit latitudeChanged();
+  if (!qFuzzyCompare(m_values.latitude, latitude)) {
+    m_values.latitude = latitude;
+    changed();
   }
 }
 
 QString Settings::locationName() const {
-  return value("location/name", DEFAULT_LOCATION_NAME).toString();
+  return m_values.locationName;
 }
 
 void Settings::setLocationName(const QString& locationName) {
-  if (Settings::locationName() != locationName) {
-    setValue("location/name", locationName);
-    emit locationNameChanged();
+  if (m_values.locationName != locationName) {
+    m_values.locationName = locationName;
+    changed();
   }
 }
 
 qreal Settings::altitude() const {
-  return value("location/altitude", DEFAULT_ALTITUDE).toReal();
+  return m_values.altitude;
 }
 
 void Settings::setAltitude(qreal altitude) {
-  if (!qFuzzyCompare(Settings::altitude(), altitude)) {
-    setValue("location/altitude", altitude);
-    emit altitudeChanged();
+  if (!qFuzzyCompare(m_values.altitude, altitude)) {
+    m_values.altitude = altitude;
+    changed();
   }
 }
 
 int Settings::calculationMethod() const {
-  return value("location/calculationMethod", DEFAULT_CALCULATION_METHOD).toInt();
+  return m_values.calculationMethod;
 }
 
 void Settings::setCalculationMethod(int calculationMethod) {
-  if (Settings::calculationMethod() != calculationMethod) {
-    setValue("location/calculationMethod", calculationMethod);
-    emit calculationMethodChanged();
+  if (m_values.calculationMethod != calculationMethod) {
+    m_values.calculationMethod = calculationMethod;
+    changed();
+  }
+}
+
+void Settings::begin() {
+  m_transactions++;
+}
+
+void Settings::commit() {
+  if (m_transactions == 0) {
+    qWarning("Settings::commit() called without begin()");
+    return;
+  }
+
+  if (--m_transactions == 0 && m_changed) {
+    m_changed = false;
+    emit locationChanged();
+    m_flushTimer.start();
+  }
+}
+
+void Settings::changed() {
+  m_dirty = true;
+
+  if (m_transactions > 0) {
+    m_changed = true;
+  } else {
+    emit locationChanged();
+    m_flushTimer.start();
+  }
+}
+
+void Settings::flush() {
+  // Only complete transactions are written, and values changed during a
+  // write are written again once it finishes
+  if (!m_dirty || m_transactions > 0 || m_flushWatcher.isRunning()) {
+    return;
   }
+
+  m_dirty = false;
+  m_flushWatcher.setFuture(QtConcurrent::run(&Settings::write, fileName(), m_values));
+}
+
+void Settings::flushFinished() {
+  flush();
+}
+
+// Runs on a worker thread, with its own QSettings since they can't be
+// shared between threads
+void Settings::write(const QString& path, const Values& values) {
+  QSettings settings(path, QSettings::IniFormat);
+  settings.setValue("location/longitude", values.longitude);
+  settings.setValue("location/latitude", values.latitude);
+  settings.setValue("location/altitude", values.altitude);
+  settings.setValue("location/name", values.locationName);
+  settings.setValue("location/calculationMethod", values.calculationMethod);
+  settings.sync();
 }
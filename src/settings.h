@@ -21,14 +21,16 @@
 #define SETTINGS_H
 
 #include <QSettings>
+#include <QTimer>
+#include <QFutureWatcher>
 
 class Settings : public QSettings {
   Q_OBJECT
-  Q_PROPERTY(qreal longitude READ longitude WRITE setLongitude NOTIFY longitudeChanged);
-  Q_PROPERTY(qreal latitude READ latitude WRITE setLatitude NOTIFY latitudeChanged);
-  Q_PROPERTY(QString locationName READ locationName WRITE setLocationName NOTIFY locationNameChanged);
-  Q_PROPERTY(qreal altitude READ altitude WRITE setAltitude NOTIFY altitudeChanged);
-  Q_PROPERTY(int calculationMethod READ calculationMethod WRITE setCalculationMethod NOTIFY calculationMethodChanged);
+  Q_PROPERTY(qreal longitude READ longitude WRITE setLongitude NOTIFY locationChanged);
+  Q_PROPERTY(qreal latitude READ latitude WRITE setLatitude NOTIFY locationChanged);
+  Q_PROPERTY(QString locationName READ locationName WRITE setLocationName NOTIFY locationChanged);
+  Q_PROPERTY(qreal altitude READ altitude WRITE setAltitude NOTIFY locationChanged);
+  Q_PROPERTY(int calculationMethod READ calculationMethod WRITE setCalculationMethod NOTIFY locationChanged);
 
 public:
   Settings(QObject *parent = 0);
@@ -49,12 +51,37 @@ public:
   int calculationMethod() const;
   void setCalculationMethod(int calculationMethod);
 
+  // Changes made between begin() and commit() are notified once, by
+  // commit(). Transactions may be nested.
+  Q_INVOKABLE void begin();
+  Q_INVOKABLE void commit();
+
 signals:
-  void longitudeChanged();
-  void latitudeChanged();
-  void locationNameChanged();
-  void altitudeChanged();
-  void calculationMethodChanged();
+  void locationChanged();
+
+private slots:
+  void flush();
+  void flushFinished();
+
+private:
+  // Values kept in memory, read from the file once
+  struct Values {
+    qreal longitude;
+    qreal latitude;
+    qreal altitude;
+    QString locationName;
+    int calculationMethod;
+  };
+
+  void changed();
+  static void write(const QString& path, const Values& values);
+
+  Values m_values;
+  int m_transactions;
+  bool m_changed;
+  bool m_dirty;
+  QTimer m_flushTimer;
+  QFutureWatcher<void> m_flushWatcher;
 };
 
 #endif /* SETTINGS_H */
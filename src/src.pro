@@ -2,7 +2,7 @@ TEMPLATE = app
 
 TARGET = harbour-prayer
 
-QT += qml quick
+QT += qml quick concurrent
 CONFIG += link_pkgconfig
 PKGCONFIG += qdeclarative5-boostable
 
@@ -12,12 +12,24 @@ DEPENDPATH += ../prayertimes/
 
 SOURCES += main.cpp \
            settings.cpp \
-           prayertimecalculator.cpp
+           prayertimecalculator.cpp \
+           timetablemodel.cpp \
+           timessnapshot.cpp \
+           prayerscheduler.cpp \
+           citysearchmodel.cpp
 
 HEADERS += prayertimes.hpp \
            settings.h \
-           prayertimecalculator.h
+           prayertimecalculator.h \
+           timetablemodel.h \
+           timessnapshot.h \
+           prayerscheduler.h \
+           citysearchmodel.h \
+           citydb.hpp
 
 RESOURCES += ../qml/qml.qrc
 
 QMAKE_CXXFLAGS += -std=c++0x #-Wall -W -Werror
+
+target.path = /usr/bin
+INSTALLS += target
@@ -0,0 +1,171 @@
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timessnapshot.h"
+#include "prayertimes.hpp"
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QHash>
+#include <limits>
+#include <cmath>
+
+#define SNAPSHOT_MAGIC        quint32(0x50525453)   // "PRTS"
+#define SNAPSHOT_VERSION      quint16(1)
+#define SNAPSHOT_MAX_DAYS     366
+#define MISSING_TIME          std::numeric_limits<qint32>::min()
+
+TimesSnapshot::TimesSnapshot() :
+  m_key(0),
+  m_days(0) {
+
+}
+
+QString TimesSnapshot::defaultPath() {
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QDir::separator() + "times.snapshot";
+}
+
+quint32 TimesSnapshot::key(qreal longitude, qreal latitude, qreal altitude, int calculationMethod) {
+  // Times also depend on the local timezone, whose rules are summed up by
+  // its offsets in winter and summer
+  int year = QDate::currentDate().year();
+
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream << SNAPSHOT_VERSION << longitude << latitude << altitude << qint32(calculationMethod)
+         << prayertimes::PrayerTimes::get_timezone(year, 1, 1)
+         << prayertimes::PrayerTimes::get_timezone(year, 7, 1);
+  return qHash(data);
+}
+
+TimesSnapshot TimesSnapshot::compute(qreal longitude, qreal latitude, qreal altitude, int calculationMethod,
+                                     const QDate& start, int days) {
+  prayertimes::PrayerTimes times;
+  times.set_calc_method(static_cast<prayertimes::CalculationMethod>(calculationMethod));
+
+  QVector<double> output(days * prayertimes::TimesCount);
+  times.get_prayer_times_range(start.year(), start.month(), start.day(), days,
+                               latitude, longitude, altitude, NAN, output.data());
+
+  TimesSnapshot snapshot;
+  snapshot.m_key = key(longitude, latitude, altitude, calculationMethod);
+  snapshot.m_start = start;
+  snapshot.m_days = days;
+  snapshot.m_times.resize(output.size());
+  for (int x = 0; x < output.size(); x++) {
+    snapshot.m_times[x] = std::isnan(output[x]) ? MISSING_TIME : qint32(qRound(output[x]));
+  }
+
+  return snapshot;
+}
+
+bool TimesSnapshot::load(const QString& path) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  QDataStream stream(&file);
+  quint32 magic;
+  quint16 version;
+  quint32 key;
+  qint64 start;
+  quint16 days;
+  stream >> magic >> version >> key >> start >> days;
+  if (stream.status() != QDataStream::Ok || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION ||
+      days == 0 || days > SNAPSHOT_MAX_DAYS) {
+    return false;
+  }
+
+  QVector<qint32> times(days * prayertimes::TimesCount);
+  for (int x = 0; x < times.size(); x++) {
+    stream >> times[x];
+  }
+  if (stream.status() != QDataStream::Ok) {
+    return false;
+  }
+
+  m_key = key;
+  m_start = QDate::fromJulianDay(start);
+  m_days = days;
+  m_times = times;
+  return true;
+}
+
+bool TimesSnapshot::save(const QString& path) const {
+  if (!isValid()) {
+    return false;
+  }
+
+  QDir().mkpath(QFileInfo(path).absolutePath());
+
+  // Written aside and renamed, so that a start never reads a partial file
+  QString temporary = path + ".new";
+  QFile file(temporary);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+
+  QDataStream stream(&file);
+  stream << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << m_key << qint64(m_start.toJulianDay()) << quint16(m_days);
+  for (int x = 0; x < m_times.size(); x++) {
+    stream << m_times[x];
+  }
+  file.close();
+
+  if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError) {
+    QFile::remove(temporary);
+    return false;
+  }
+
+  QFile::remove(path);
+  return QFile::rename(temporary, path);
+}
+
+bool TimesSnapshot::isValid() const {
+  return m_start.isValid() && m_days > 0;
+}
+
+quint32 TimesSnapshot::key() const {
+  return m_key;
+}
+
+bool TimesSnapshot::covers(const QDate& date, quint32 key) const {
+  if (!isValid() || m_key != key) {
+    return false;
+  }
+
+  qint64 day = m_start.daysTo(date);
+  return day >= 0 && day < m_days;
+}
+
+QMap<int, double> TimesSnapshot::times(const QDate& date, const QList<int>& positions) const {
+  QMap<int, double> result;
+  qint64 day = m_start.daysTo(date);
+  if (!isValid() || day < 0 || day >= m_days) {
+    return result;
+  }
+
+  for (int x = 0; x < positions.size(); x++) {
+    qint32 time = m_times[int(day) * prayertimes::TimesCount + positions[x]];
+    result.insert(positions[x], time == MISSING_TIME ? NAN : double(time));
+  }
+
+  return result;
+}
@@ -0,0 +1,61 @@
+// -*-c++-*-
+
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMES_SNAPSHOT_H
+#define TIMES_SNAPSHOT_H
+
+#include <QDate>
+#include <QMap>
+#include <QVector>
+#include <QString>
+
+// Prayer times of a few consecutive days, saved to a small binary file so
+// that the next start can show them before computing anything. A snapshot
+// is keyed by a hash of everything the times depend on.
+class TimesSnapshot {
+public:
+  TimesSnapshot();
+
+  static QString defaultPath();
+  static quint32 key(qreal longitude, qreal latitude, qreal altitude, int calculationMethod);
+
+  // Compute the times of days days starting at start
+  static TimesSnapshot compute(qreal longitude, qreal latitude, qreal altitude, int calculationMethod,
+                               const QDate& start, int days);
+
+  bool load(const QString& path);
+  bool save(const QString& path) const;
+
+  bool isValid() const;
+  quint32 key() const;
+
+  // Whether the snapshot has the times of a date and was made for a key
+  bool covers(const QDate& date, quint32 key) const;
+
+  // Get the times of a date, in seconds as returned by the engine
+  QMap<int, double> times(const QDate& date, const QList<int>& positions) const;
+
+private:
+  quint32 m_key;
+  QDate m_start;
+  int m_days;
+  QVector<qint32> m_times;
+};
+
+#endif /* TIMES_SNAPSHOT_H */
@@ -0,0 +1,218 @@
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timetablemodel.h"
+#include "prayertimes.hpp"
+#include <QDateTime>
+#include <cmath>
+
+#define FETCH_BLOCK_DAYS      31
+#define DEFAULT_DAYS          365
+
+static const int TimePositions[] = {
+  prayertimes::Fajr,
+  prayertimes::Sunrise,
+  prayertimes::Dhuhr,
+  prayertimes::Asr,
+  prayertimes::Maghrib,
+  prayertimes::Isha,
+};
+
+TimetableModel::TimetableModel(QObject *parent) :
+  QAbstractListModel(parent),
+  m_rows(0),
+  m_longitude(qQNaN()),
+  m_latitude(qQNaN()),
+  m_altitude(qQNaN()),
+  m_calculationMethod(-1),
+  m_startDate(QDate::currentDate()),
+  m_days(DEFAULT_DAYS) {
+
+  // Changes made in the same event loop turn reset the model once
+  m_timer.setSingleShot(true);
+  m_timer.setInterval(0);
+  QObject::connect(&m_timer, SIGNAL(timeout()), this, SLOT(reset()));
+}
+
+TimetableModel::~TimetableModel() {
+
+}
+
+qreal TimetableModel::longitude() const {
+  return m_longitude;
+}
+
+void TimetableModel::setLongitude(qreal longitude) {
+  if (!qFuzzyCompare(m_longitude, longitude)) {
+    m_longitude = longitude;
+    emit longitudeChanged();
+    scheduleReset();
+  }
+}
+
+qreal TimetableModel::latitude() const {
+  return m_latitude;
+}
+
+void TimetableModel::setLatitude(qreal latitude) {
+  if (!qFuzzyCompare(m_latitude, latitude)) {
+    m_latitude = latitude;
+    emit latitudeChanged();
+    scheduleReset();
+  }
+}
+
+qreal TimetableModel::altitude() const {
+  return m_altitude;
+}
+
+void TimetableModel::setAltitude(qreal altitude) {
+  if (!qFuzzyCompare(m_altitude, altitude)) {
+    m_altitude = altitude;
+    emit altitudeChanged();
+    scheduleReset();
+  }
+}
+
+int TimetableModel::calculationMethod() const {
+  return m_calculationMethod;
+}
+
+void TimetableModel::setCalculationMethod(int calculationMethod) {
+  if (m_calculationMethod != calculationMethod) {
+    m_calculationMethod = calculationMethod;
+    emit calculationMethodChanged();
+    scheduleReset();
+  }
+}
+
+QDate TimetableModel::startDate() const {
+  return m_startDate;
+}
+
+void TimetableModel::setStartDate(const QDate& startDate) {
+  if (m_startDate != startDate) {
+    m_startDate = startDate;
+    emit startDateChanged();
+    scheduleReset();
+  }
+}
+
+int TimetableModel::days() const {
+  return m_days;
+}
+
+void TimetableModel::setDays(int days) {
+  if (m_days != days) {
+    m_days = days;
+    emit daysChanged();
+    scheduleReset();
+  }
+}
+
+int TimetableModel::rowCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : m_rows;
+}
+
+QVariant TimetableModel::data(const QModelIndex& index, int role) const {
+  if (!index.isValid() || index.row() >= m_rows) {
+    return QVariant();
+  }
+
+  QDate date = m_startDate.addDays(index.row());
+  if (role == DateRole) {
+    return date;
+  }
+
+  if (role < FajrRole || role > IshaRole) {
+    return QVariant();
+  }
+
+  double time = m_times[index.row() * prayertimes::TimesCount + TimePositions[role - FajrRole]];
+  if (std::isnan(time)) {
+    return QVariant();
+  }
+
+  // Times are wall clock seconds from midnight, past 24 hours on the next
+  // day, so build them from the date and time of day rather than adding
+  // seconds, which would be off by the change on daylight saving days
+  int seconds = qRound(time);
+  int days = seconds >= 0 ? seconds / 86400 : -((86399 - seconds) / 86400);
+  seconds -= days * 86400;
+
+  return QDateTime(date.addDays(days), QTime(0, 0).addSecs(seconds));
+}
+
+QHash<int, QByteArray> TimetableModel::roleNames() const {
+  QHash<int, QByteArray> roles;
+  roles[DateRole] = "date";
+  roles[FajrRole] = "fajr";
+  roles[SunriseRole] = "sunrise";
+  roles[DhuhrRole] = "dhuhr";
+  roles[AsrRole] = "asr";
+  roles[MaghribRole] = "maghrib";
+  roles[IshaRole] = "isha";
+  return roles;
+}
+
+bool TimetableModel::canFetchMore(const QModelIndex& parent) const {
+  return !parent.isValid() && isValid() && !m_timer.isActive() && m_rows < m_days;
+}
+
+void TimetableModel::fetchMore(const QModelIndex& parent) {
+  if (!canFetchMore(parent)) {
+    return;
+  }
+
+  int count = qMin(FETCH_BLOCK_DAYS, m_days - m_rows);
+  QDate first = m_startDate.addDays(m_rows);
+
+  prayertimes::PrayerTimes times;
+  times.set_calc_method(static_cast<prayertimes::CalculationMethod>(m_calculationMethod));
+
+  // The range computation shares sun positions between days and follows
+  // daylight saving changes of the local timezone
+  m_times.resize((m_rows + count) * prayertimes::TimesCount);
+  times.get_prayer_times_range(first.year(), first.month(), first.day(), count,
+                               m_latitude, m_longitude, m_altitude, NAN,
+                               m_times.data() + m_rows * prayertimes::TimesCount);
+
+  beginInsertRows(QModelIndex(), m_rows, m_rows + count - 1);
+  m_rows += count;
+  endInsertRows();
+}
+
+void TimetableModel::scheduleReset() {
+  if (!m_timer.isActive()) {
+    m_timer.start();
+  }
+}
+
+void TimetableModel::reset() {
+  m_timer.stop();
+
+  beginResetModel();
+  m_times.clear();
+  m_rows = 0;
+  endResetModel();
+}
+
+bool TimetableModel::isValid() const {
+  // Coordinates may be negative, so unset ones are NaN
+  return !qIsNaN(m_longitude) && !qIsNaN(m_latitude) && !qIsNaN(m_altitude) && m_calculationMethod >= 0 &&
+    m_startDate.isValid() && m_days > 0;
+}
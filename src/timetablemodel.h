@@ -0,0 +1,107 @@
+// -*-c++-*-
+
+/*
+ * This file is part of harbour-prayer.
+ *
+ * harbour-prayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMETABLE_MODEL_H
+#define TIMETABLE_MODEL_H
+
+#include <QAbstractListModel>
+#include <QDate>
+#include <QVector>
+#include <QTimer>
+
+// Prayer times of consecutive days, one row per day. Rows are computed
+// when views ask for them, a block of days at a time, and kept until the
+// location, method or dates change.
+class TimetableModel : public QAbstractListModel {
+  Q_OBJECT
+
+  Q_PROPERTY(qreal longitude READ longitude WRITE setLongitude NOTIFY longitudeChanged);
+  Q_PROPERTY(qreal latitude READ latitude WRITE setLatitude NOTIFY latitudeChanged);
+  Q_PROPERTY(qreal altitude READ altitude WRITE setAltitude NOTIFY altitudeChanged);
+  Q_PROPERTY(int calculationMethod READ calculationMethod WRITE setCalculationMethod NOTIFY calculationMethodChanged);
+  Q_PROPERTY(QDate startDate READ startDate WRITE setStartDate NOTIFY startDateChanged);
+  Q_PROPERTY(int days READ days WRITE setDays NOTIFY daysChanged);
+
+public:
+  enum {
+    DateRole = Qt::UserRole + 1,
+    FajrRole,
+    SunriseRole,
+    DhuhrRole,
+    AsrRole,
+    MaghribRole,
+    IshaRole,
+  };
+
+  TimetableModel(QObject *parent = 0);
+  ~TimetableModel();
+
+  qreal longitude() const;
+  void setLongitude(qreal longitude);
+
+  qreal latitude() const;
+  void setLatitude(qreal latitude);
+
+  qreal altitude() const;
+  void setAltitude(qreal altitude);
+
+  int calculationMethod() const;
+  void setCalculationMethod(int calculationMethod);
+
+  QDate startDate() const;
+  void setStartDate(const QDate& startDate);
+
+  int days() const;
+  void setDays(int days);
+
+  int rowCount(const QModelIndex& parent = QModelIndex()) const;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+  QHash<int, QByteArray> roleNames() const;
+
+  bool canFetchMore(const QModelIndex& parent) const;
+  void fetchMore(const QModelIndex& parent);
+
+private slots:
+  void reset();
+
+signals:
+  void longitudeChanged();
+  void latitudeChanged();
+  void altitudeChanged();
+  void calculationMethodChanged();
+  void startDateChanged();
+  void daysChanged();
+
+private:
+  void scheduleReset();
+  bool isValid() const;
+
+  QVector<double> m_times;
+  int m_rows;
+  QTimer m_timer;
+
+  qreal m_longitude;
+  qreal m_latitude;
+  qreal m_altitude;
+  int m_calculationMethod;
+  QDate m_startDate;
+  int m_days;
+};
+
+#endif /* TIMETABLE_MODEL_H */